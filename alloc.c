@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+
+// Block of memory that cells of one size class are cut from
+struct lslab {
+  struct lslab* next;
+  size_t used;
+  size_t size;
+  char* data;
+};
+
+//Heap of the interpreter this thread has entered, threads that have not
+//entered one allocate from a heap of their own
+static __thread struct lheap* current = NULL;
+static __thread struct lheap own;
+
+static struct lheap* lalloc_heap(void) {
+  return current ? current : &own;
+}
+
+struct lheap* lalloc_use(struct lheap* h) {
+  struct lheap* prev = current;
+  current = h;
+  return prev;
+}
+
+//Release every slab of h at once, along with any cells still in them
+void lheap_free(struct lheap* h) {
+  struct lslab* next;
+  for (struct lslab* s = h->slabs; s; s = next) {
+    next = s->next;
+    free(s->data);
+    free(s);
+  }
+  memset(h, 0, sizeof(struct lheap));
+}
+
+//Find the size class for a request
+static int lalloc_class(size_t size) {
+  return (size + LALLOC_ALIGN - 1) / LALLOC_ALIGN - 1;
+}
+
+//Cut a new cell of the class size from the current slab
+static void* lslab_cell(struct lheap* h, size_t size) {
+  struct lslab* s = h->slabs;
+  if (s == NULL || s->used + size > s->size) {
+    s = malloc(sizeof(struct lslab));
+    s->used = 0;
+    s->size = LALLOC_SLAB_SIZE;
+    s->data = malloc(s->size);
+    s->next = h->slabs;
+    h->slabs = s;
+    h->nslabs++;
+  }
+
+  void* p = s->data + s->used;
+  s->used += size;
+  return p;
+}
+
+void* lalloc(size_t size) {
+#ifdef LALLOC_DEBUG
+  return malloc(size);
+#endif
+  if (size > LALLOC_MAX) { return malloc(size); }
+
+  struct lheap* h = lalloc_heap();
+  struct lpool* pool = &h->pools[lalloc_class(size)];
+  pool->allocs++;
+
+  //Reuse a freed cell if there is one
+  void* p = pool->free;
+  if (p) {
+    pool->free = *(void**)p;
+    return p;
+  }
+  return lslab_cell(h, (lalloc_class(size) + 1) * LALLOC_ALIGN);
+}
+
+//Return a cell to its size class, size must match the lalloc call
+void lfree(void* p, size_t size) {
+#ifdef LALLOC_DEBUG
+  free(p); return;
+#endif
+  if (size > LALLOC_MAX) { free(p); return; }
+
+  struct lpool* pool = &lalloc_heap()->pools[lalloc_class(size)];
+  pool->frees++;
+
+  *(void**)p = pool->free;
+  pool->free = p;
+}
+
+//Resize a cell from old to size bytes. Cells staying in the same size
+//class are not moved. A size of zero frees the cell and returns NULL.
+void* lrealloc(void* p, size_t old, size_t size) {
+#ifdef LALLOC_DEBUG
+  if (size == 0) { free(p); return NULL; }
+  return realloc(p, size);
+#endif
+  if (old == size) { return p; }
+  if (old > LALLOC_MAX && size > LALLOC_MAX) { return realloc(p, size); }
+  if (old && size && old <= LALLOC_MAX && size <= LALLOC_MAX
+      && lalloc_class(old) == lalloc_class(size)) {
+    return p;
+  }
+
+  void* n = size ? lalloc(size) : NULL;
+  if (n && old) { memcpy(n, p, old < size ? old : size); }
+  if (old) { lfree(p, old); }
+  return n;
+}
+
+//Report totals over all size classes
+void lalloc_stats(long* allocs, long* frees, long* nslabs) {
+  struct lheap* h = lalloc_heap();
+  *allocs = 0;
+  *frees = 0;
+  for (int i = 0; i < LALLOC_CLASSES; i++) {
+    *allocs += h->pools[i].allocs;
+    *frees += h->pools[i].frees;
+  }
+  *nslabs = h->nslabs;
+}
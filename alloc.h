@@ -0,0 +1,38 @@
+#include <stddef.h>
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+// Cells up to LALLOC_MAX bytes are rounded up to a multiple of
+// LALLOC_ALIGN and served from slabs, larger requests go to malloc.
+#define LALLOC_ALIGN 16
+#define LALLOC_MAX 256
+#define LALLOC_CLASSES (LALLOC_MAX / LALLOC_ALIGN)
+#define LALLOC_SLAB_SIZE (64 * 1024)
+
+// Size class, cells are recycled through a free list
+struct lpool {
+  void* free;
+  long allocs;
+  long frees;
+};
+
+// Slab allocator state for an interpreter
+struct lheap {
+  struct lpool pools[LALLOC_CLASSES];
+  struct lslab* slabs;
+  long nslabs;
+};
+
+void* lalloc(size_t size);
+void lfree(void* p, size_t size);
+void* lrealloc(void* p, size_t old, size_t size);
+
+//Allocate from h on this thread, NULL for the thread's own heap. Returns
+//the heap used before.
+struct lheap* lalloc_use(struct lheap* h);
+void lheap_free(struct lheap* h);
+
+void lalloc_stats(long* allocs, long* frees, long* nslabs);
+
+#endif
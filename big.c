@@ -0,0 +1,465 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "alloc.h"
+#include "big.h"
+
+static size_t big_size(int cap) {
+  return offsetof(struct lbig, d) + sizeof(uint32_t) * cap;
+}
+
+//Allocate a zero with room for cap limbs
+struct lbig* big_new(int cap) {
+  struct lbig* b = lalloc(big_size(cap));
+  b->neg = 0;
+  b->n = 0;
+  b->cap = cap;
+  return b;
+}
+
+struct lbig* big_copy(struct lbig* b) {
+  struct lbig* x = big_new(b->n);
+  x->neg = b->neg;
+  x->n = b->n;
+  memcpy(x->d, b->d, sizeof(uint32_t) * b->n);
+  return x;
+}
+
+void big_del(struct lbig* b) {
+  lfree(b, big_size(b->cap));
+}
+
+//Drop leading zero limbs, zero is never negative
+static struct lbig* big_trim(struct lbig* b) {
+  while (b->n > 0 && b->d[b->n-1] == 0) { b->n--; }
+  if (b->n == 0) { b->neg = 0; }
+  return b;
+}
+
+//Magnitudes are limb arrays with a length, which may have leading zeros
+
+static int mag_cmp(uint32_t* a, int an, uint32_t* b, int bn) {
+  while (an > 0 && a[an-1] == 0) { an--; }
+  while (bn > 0 && b[bn-1] == 0) { bn--; }
+  if (an != bn) { return an < bn ? -1 : 1; }
+  for (int i = an-1; i >= 0; i--) {
+    if (a[i] != b[i]) { return a[i] < b[i] ? -1 : 1; }
+  }
+  return 0;
+}
+
+//r = a + b, r has room for max(an, bn) + 1 limbs. Returns the length.
+static int mag_add(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn) {
+  if (an < bn) {
+    uint32_t* t = a; a = b; b = t;
+    int tn = an; an = bn; bn = tn;
+  }
+  uint64_t c = 0;
+  for (int i = 0; i < bn; i++) {
+    c += (uint64_t)a[i] + b[i];
+    r[i] = (uint32_t)c;
+    c >>= 32;
+  }
+  for (int i = bn; i < an; i++) {
+    c += a[i];
+    r[i] = (uint32_t)c;
+    c >>= 32;
+  }
+  r[an] = (uint32_t)c;
+  return an + 1;
+}
+
+//r = a - b where a >= b, r has room for an limbs
+static void mag_sub(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn) {
+  int64_t borrow = 0;
+  for (int i = 0; i < an; i++) {
+    int64_t t = (int64_t)a[i] - (i < bn ? b[i] : 0) - borrow;
+    borrow = t < 0;
+    r[i] = (uint32_t)t;
+  }
+}
+
+//r += x in place, r must be large enough to hold the sum
+static void mag_add_to(uint32_t* r, int rn, uint32_t* x, int xn) {
+  uint64_t c = 0;
+  int i;
+  for (i = 0; i < xn; i++) {
+    c += (uint64_t)r[i] + x[i];
+    r[i] = (uint32_t)c;
+    c >>= 32;
+  }
+  for (; c && i < rn; i++) {
+    c += r[i];
+    r[i] = (uint32_t)c;
+    c >>= 32;
+  }
+}
+
+//r -= x in place, r must be at least x
+static void mag_sub_from(uint32_t* r, int rn, uint32_t* x, int xn) {
+  while (xn > 0 && x[xn-1] == 0) { xn--; }
+  int64_t borrow = 0;
+  int i;
+  for (i = 0; i < xn; i++) {
+    int64_t t = (int64_t)r[i] - x[i] - borrow;
+    borrow = t < 0;
+    r[i] = (uint32_t)t;
+  }
+  for (; borrow && i < rn; i++) {
+    int64_t t = (int64_t)r[i] - borrow;
+    borrow = t < 0;
+    r[i] = (uint32_t)t;
+  }
+}
+
+//r = a * b by long multiplication, r has an + bn limbs
+static void mag_mul_long(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn) {
+  memset(r, 0, sizeof(uint32_t) * (an + bn));
+  for (int i = 0; i < an; i++) {
+    uint64_t c = 0;
+    for (int j = 0; j < bn; j++) {
+      c += (uint64_t)a[i] * b[j] + r[i+j];
+      r[i+j] = (uint32_t)c;
+      c >>= 32;
+    }
+    r[i+bn] = (uint32_t)c;
+  }
+}
+
+//r = a * b, r has an + bn limbs. Operands are split in half so the product
+//takes three half sized multiplications instead of four:
+//  a*b = z2 B^2m + ((a0 + a1)(b0 + b1) - z2 - z0) B^m + z0
+static void mag_mul(uint32_t* r, uint32_t* a, int an, uint32_t* b, int bn) {
+  if (an < bn) {
+    uint32_t* t = a; a = b; b = t;
+    int tn = an; an = bn; bn = tn;
+  }
+  if (bn < BIG_KARATSUBA) {
+    mag_mul_long(r, a, an, b, bn);
+    return;
+  }
+
+  //A much shorter b is multiplied into a piece at a time
+  if (bn * 2 <= an) {
+    uint32_t* t = malloc(sizeof(uint32_t) * bn * 2);
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+    for (int i = 0; i < an; i += bn) {
+      int n = an - i < bn ? an - i : bn;
+      mag_mul(t, a + i, n, b, bn);
+      mag_add_to(r + i, an + bn - i, t, n + bn);
+    }
+    free(t);
+    return;
+  }
+
+  int m = an / 2;
+  uint32_t *a0 = a, *a1 = a + m, *b0 = b, *b1 = b + m;
+  int a1n = an - m, b1n = bn - m;
+
+  //z0 and z2 are built in place in the low and high parts of r
+  mag_mul(r, a0, m, b0, m);
+  mag_mul(r + 2*m, a1, a1n, b1, b1n);
+
+  uint32_t* sa = malloc(sizeof(uint32_t) * (a1n + 1));
+  uint32_t* sb = malloc(sizeof(uint32_t) * (a1n + 1));
+  int san = mag_add(sa, a0, m, a1, a1n);
+  int sbn = mag_add(sb, b0, m, b1, b1n);
+
+  uint32_t* z1 = malloc(sizeof(uint32_t) * (san + sbn));
+  mag_mul(z1, sa, san, sb, sbn);
+  mag_sub_from(z1, san + sbn, r, 2*m);
+  mag_sub_from(z1, san + sbn, r + 2*m, a1n + b1n);
+
+  int z1n = san + sbn;
+  while (z1n > 0 && z1[z1n-1] == 0) { z1n--; }
+  mag_add_to(r + m, an + bn - m, z1, z1n);
+
+  free(sa);
+  free(sb);
+  free(z1);
+}
+
+//q = u / v, returning the remainder, for a single limb v
+static uint32_t mag_div_limb(uint32_t* q, uint32_t* u, int un, uint32_t v) {
+  uint64_t rem = 0;
+  for (int i = un-1; i >= 0; i--) {
+    uint64_t x = (rem << 32) | u[i];
+    q[i] = (uint32_t)(x / v);
+    rem = x % v;
+  }
+  return (uint32_t)rem;
+}
+
+//q = u / v and r = u % v by Knuth's algorithm D, un >= vn >= 2 and the top
+//limb of v is not zero. q has un - vn + 1 limbs and r has vn.
+static void mag_divmod(uint32_t* q, uint32_t* r, uint32_t* u, int un, uint32_t* v, int vn) {
+  //Normalize so the top limb of v has its high bit set, which keeps each
+  //estimated quotient limb within two of the real one
+  int s = 0;
+  while (!(v[vn-1] & (0x80000000u >> s))) { s++; }
+
+  uint32_t* vs = malloc(sizeof(uint32_t) * vn);
+  uint32_t* us = malloc(sizeof(uint32_t) * (un + 1));
+  for (int i = vn-1; i > 0; i--) {
+    vs[i] = (v[i] << s) | (s ? (uint32_t)((uint64_t)v[i-1] >> (32 - s)) : 0);
+  }
+  vs[0] = v[0] << s;
+  us[un] = s ? (uint32_t)((uint64_t)u[un-1] >> (32 - s)) : 0;
+  for (int i = un-1; i > 0; i--) {
+    us[i] = (u[i] << s) | (s ? (uint32_t)((uint64_t)u[i-1] >> (32 - s)) : 0);
+  }
+  us[0] = u[0] << s;
+
+  const uint64_t base = (uint64_t)1 << 32;
+  for (int j = un - vn; j >= 0; j--) {
+    uint64_t num = ((uint64_t)us[j+vn] << 32) | us[j+vn-1];
+    uint64_t qhat = num / vs[vn-1];
+    uint64_t rhat = num % vs[vn-1];
+    while (qhat >= base || qhat * vs[vn-2] > ((rhat << 32) | us[j+vn-2])) {
+      qhat--;
+      rhat += vs[vn-1];
+      if (rhat >= base) { break; }
+    }
+
+    //Subtract qhat * v from the current window of u
+    int64_t k = 0, t;
+    for (int i = 0; i < vn; i++) {
+      uint64_t p = qhat * vs[i];
+      t = (int64_t)us[i+j] - k - (int64_t)(p & 0xffffffffu);
+      us[i+j] = (uint32_t)t;
+      k = (int64_t)(p >> 32) - (t >> 32);
+    }
+    t = (int64_t)us[j+vn] - k;
+    us[j+vn] = (uint32_t)t;
+
+    //The estimate was one too large, add v back
+    if (t < 0) {
+      qhat--;
+      uint64_t c = 0;
+      for (int i = 0; i < vn; i++) {
+        c += (uint64_t)us[i+j] + vs[i];
+        us[i+j] = (uint32_t)c;
+        c >>= 32;
+      }
+      us[j+vn] += (uint32_t)c;
+    }
+    q[j] = (uint32_t)qhat;
+  }
+
+  for (int i = 0; i < vn; i++) {
+    r[i] = (us[i] >> s) | (s ? (uint32_t)((uint64_t)us[i+1] << (32 - s)) : 0);
+  }
+  free(vs);
+  free(us);
+}
+
+struct lbig* big_from_long(long x) {
+  struct lbig* b = big_new(2);
+  unsigned long m = x < 0 ? 0 - (unsigned long)x : (unsigned long)x;
+  b->neg = x < 0;
+  while (m) {
+    b->d[b->n++] = (uint32_t)m;
+    m = (unsigned long)((uint64_t)m >> 32);
+  }
+  return b;
+}
+
+//Convert a float holding an integer
+struct lbig* big_from_dbl(double x) {
+  int e;
+  double m = frexp(fabs(x), &e);
+  if (e <= 0) { return big_new(0); }
+
+  //Take the 53 bit mantissa as an integer, then shift it into place
+  uint64_t mant = (uint64_t)ldexp(m, 53);
+  int shift = e - 53;
+  if (shift < 0) {
+    mant >>= -shift;
+    shift = 0;
+  }
+
+  struct lbig* b = big_new(shift / 32 + 3);
+  memset(b->d, 0, sizeof(uint32_t) * b->cap);
+  int limb = shift / 32, bit = shift % 32;
+  b->d[limb] = (uint32_t)(mant << bit);
+  b->d[limb+1] = (uint32_t)(mant >> (32 - bit));
+  b->d[limb+2] = bit ? (uint32_t)(mant >> (64 - bit)) : 0;
+  b->n = b->cap;
+  b->neg = x < 0;
+  return big_trim(b);
+}
+
+//Read an optional minus sign and decimal digits, nine at a time
+struct lbig* big_from_dec(char* s, size_t len) {
+  int neg = len > 0 && *s == '-';
+  if (neg) { s++; len--; }
+
+  //Each limb holds more than nine digits
+  struct lbig* b = big_new(len / 9 + 2);
+  memset(b->d, 0, sizeof(uint32_t) * b->cap);
+  size_t i = 0;
+  while (i < len) {
+    uint32_t chunk = 0, scale = 1;
+    for (int k = 0; k < 9 && i < len; k++, i++) {
+      chunk = chunk * 10 + (s[i] - '0');
+      scale *= 10;
+    }
+
+    //b = b * scale + chunk
+    uint64_t c = chunk;
+    for (int k = 0; k < b->n; k++) {
+      c += (uint64_t)b->d[k] * scale;
+      b->d[k] = (uint32_t)c;
+      c >>= 32;
+    }
+    if (c) { b->d[b->n++] = (uint32_t)c; }
+  }
+  b->neg = neg;
+  return big_trim(b);
+}
+
+int big_to_long(struct lbig* b, long* x) {
+  if (b->n > 2) { return 0; }
+  uint64_t m = 0;
+  for (int i = b->n-1; i >= 0; i--) { m = (m << 32) | b->d[i]; }
+
+  if (!b->neg && m <= (uint64_t)LONG_MAX) { *x = (long)m; return 1; }
+  if (b->neg && m <= (uint64_t)LONG_MAX + 1) { *x = (long)(0 - m); return 1; }
+  return 0;
+}
+
+double big_to_dbl(struct lbig* b) {
+  double x = 0;
+  for (int i = b->n-1; i >= 0; i--) { x = x * 4294967296.0 + b->d[i]; }
+  return b->neg ? -x : x;
+}
+
+//Write b in decimal by taking off nine digits at a time
+char* big_to_dec(struct lbig* b) {
+  //Each limb gives fewer than ten digits
+  size_t size = (size_t)b->n * 10 + 2;
+  char* s = malloc(size);
+  char* p = s + size - 1;
+  *p = '\0';
+
+  uint32_t* t = malloc(sizeof(uint32_t) * (b->n + 1));
+  memcpy(t, b->d, sizeof(uint32_t) * b->n);
+  int n = b->n;
+  do {
+    uint32_t rem = mag_div_limb(t, t, n, 1000000000u);
+    while (n > 0 && t[n-1] == 0) { n--; }
+    for (int k = 0; k < 9; k++) {
+      *--p = '0' + rem % 10;
+      rem /= 10;
+      if (n == 0 && rem == 0) { break; }
+    }
+  } while (n > 0);
+  free(t);
+
+  if (b->neg) { *--p = '-'; }
+  memmove(s, p, strlen(p) + 1);
+  return s;
+}
+
+int big_cmp(struct lbig* a, struct lbig* b) {
+  if (a->neg != b->neg) { return a->neg ? -1 : 1; }
+  int c = mag_cmp(a->d, a->n, b->d, b->n);
+  return a->neg ? -c : c;
+}
+
+struct lbig* big_neg(struct lbig* a) {
+  struct lbig* x = big_copy(a);
+  if (x->n) { x->neg = !x->neg; }
+  return x;
+}
+
+//a + b with the sign of b given separately, so it also subtracts
+static struct lbig* big_add_signed(struct lbig* a, struct lbig* b, int bneg) {
+  int n = a->n > b->n ? a->n : b->n;
+  struct lbig* x = big_new(n + 1);
+  if (a->neg == bneg) {
+    x->n = mag_add(x->d, a->d, a->n, b->d, b->n);
+    x->neg = a->neg;
+  } else if (mag_cmp(a->d, a->n, b->d, b->n) >= 0) {
+    mag_sub(x->d, a->d, a->n, b->d, b->n);
+    x->n = a->n;
+    x->neg = a->neg;
+  } else {
+    mag_sub(x->d, b->d, b->n, a->d, a->n);
+    x->n = b->n;
+    x->neg = bneg;
+  }
+  return big_trim(x);
+}
+
+struct lbig* big_add(struct lbig* a, struct lbig* b) { return big_add_signed(a, b, b->neg); }
+struct lbig* big_sub(struct lbig* a, struct lbig* b) { return big_add_signed(a, b, !b->neg); }
+
+struct lbig* big_mul(struct lbig* a, struct lbig* b) {
+  struct lbig* x = big_new(a->n + b->n);
+  if (a->n && b->n) {
+    mag_mul(x->d, a->d, a->n, b->d, b->n);
+    x->n = a->n + b->n;
+    x->neg = a->neg != b->neg;
+  }
+  return big_trim(x);
+}
+
+//Quotient and remainder of a by b, which must not be zero. Either result
+//may be NULL if it is not wanted.
+static void big_divmod(struct lbig* a, struct lbig* b, struct lbig** q, struct lbig** r) {
+  if (mag_cmp(a->d, a->n, b->d, b->n) < 0) {
+    if (q) { *q = big_new(0); }
+    if (r) { *r = big_copy(a); }
+    return;
+  }
+
+  struct lbig* qx = big_new(a->n - b->n + 1);
+  struct lbig* rx = big_new(b->n);
+  if (b->n == 1) {
+    rx->d[0] = mag_div_limb(qx->d, a->d, a->n, b->d[0]);
+  } else {
+    mag_divmod(qx->d, rx->d, a->d, a->n, b->d, b->n);
+  }
+  qx->n = qx->cap;
+  qx->neg = a->neg != b->neg;
+  rx->n = rx->cap;
+  rx->neg = a->neg;
+
+  if (q) { *q = big_trim(qx); } else { big_del(qx); }
+  if (r) { *r = big_trim(rx); } else { big_del(rx); }
+}
+
+struct lbig* big_div(struct lbig* a, struct lbig* b) {
+  struct lbig* q;
+  big_divmod(a, b, &q, NULL);
+  return q;
+}
+
+struct lbig* big_mod(struct lbig* a, struct lbig* b) {
+  struct lbig* r;
+  big_divmod(a, b, NULL, &r);
+  return r;
+}
+
+//Power by squaring
+struct lbig* big_pow(struct lbig* a, unsigned long e) {
+  struct lbig* r = big_from_long(1);
+  struct lbig* b = big_copy(a);
+  while (e) {
+    if (e & 1) {
+      struct lbig* t = big_mul(r, b);
+      big_del(r);
+      r = t;
+    }
+    e >>= 1;
+    if (e) {
+      struct lbig* t = big_mul(b, b);
+      big_del(b);
+      b = t;
+    }
+  }
+  big_del(b);
+  return r;
+}
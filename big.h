@@ -0,0 +1,43 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef BIG_H
+#define BIG_H
+
+// Products of operands with at least this many limbs are split with
+// Karatsuba, smaller ones use long multiplication
+#define BIG_KARATSUBA 32
+
+// Arbitrary precision integer, sign and magnitude in base 2^32 limbs with
+// the least significant first. The top limb is not zero, zero has no limbs.
+struct lbig {
+  int neg;
+  int n;
+  int cap;
+  uint32_t d[];
+};
+
+struct lbig* big_new(int cap);
+struct lbig* big_copy(struct lbig* b);
+void big_del(struct lbig* b);
+
+//Conversions, big_to_long returns 0 if b does not fit
+struct lbig* big_from_long(long x);
+struct lbig* big_from_dbl(double x);
+struct lbig* big_from_dec(char* s, size_t len);
+int big_to_long(struct lbig* b, long* x);
+double big_to_dbl(struct lbig* b);
+char* big_to_dec(struct lbig* b);
+
+//Arithmetic, operands are left as they are and a new result returned.
+//Division truncates towards zero, as it does for long.
+int big_cmp(struct lbig* a, struct lbig* b);
+struct lbig* big_neg(struct lbig* a);
+struct lbig* big_add(struct lbig* a, struct lbig* b);
+struct lbig* big_sub(struct lbig* a, struct lbig* b);
+struct lbig* big_mul(struct lbig* a, struct lbig* b);
+struct lbig* big_div(struct lbig* a, struct lbig* b);
+struct lbig* big_mod(struct lbig* a, struct lbig* b);
+struct lbig* big_pow(struct lbig* a, unsigned long e);
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef BLISP_H
+#define BLISP_H
+
+// Embedding interface, the only header a program linking libblisp needs.
+// Interpreters and values are opaque, their layout may change between
+// versions while these functions keep working the same way.
+//
+// Each interpreter has its own global environment and heap. A thread may
+// use any interpreter, but one interpreter must only be used by one thread
+// at a time. Values belong to the interpreter they came from and are only
+// given to functions along with it. Values returned to the caller are
+// owned by it and released with blisp_free.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Exported from the shared library, which hides everything else
+#ifdef __GNUC__
+#define BLISP_API __attribute__((visibility("default")))
+#else
+#define BLISP_API
+#endif
+
+struct linterp;
+struct lval;
+struct lenv;
+typedef struct linterp blisp_interp;
+typedef struct lval blisp_value;
+typedef struct lenv blisp_env;
+
+// Options for blisp_new
+#define BLISP_VM  1   // Evaluate through the bytecode vm
+#define BLISP_MPC 2   // Read source through the mpc grammar
+#define BLISP_GC  4   // Trace the heap between expressions and on blisp_collect
+
+// Kinds of value, integers are of any size
+enum blisp_type {
+  BLISP_INT, BLISP_FLOAT, BLISP_STRING, BLISP_SYMBOL, BLISP_LIST,
+  BLISP_FUNCTION, BLISP_MAP, BLISP_VECTOR, BLISP_ERROR, BLISP_FUTURE
+};
+
+// Function called from lisp with its arguments as a list, which it owns
+// and must release. Returns a new value, or an error made by blisp_error.
+// Use blisp_current for the interpreter calling it.
+typedef blisp_value* (*blisp_native)(blisp_env* env, blisp_value* args);
+
+//Create an interpreter with the builtins defined, or delete one along
+//with every value still left in it
+BLISP_API blisp_interp* blisp_new(int flags);
+BLISP_API void blisp_del(blisp_interp* b);
+
+//Interpreter running on this thread, from inside a native function
+BLISP_API blisp_interp* blisp_current(void);
+
+//Evaluate each expression in the source or file in turn, returning the
+//value of the last or the first error
+BLISP_API blisp_value* blisp_eval_string(blisp_interp* b, const char* src);
+BLISP_API blisp_value* blisp_eval_file(blisp_interp* b, const char* filename);
+
+//Bind a native function or a value, which is consumed, to a global name
+BLISP_API void blisp_register(blisp_interp* b, const char* name, blisp_native func);
+BLISP_API void blisp_define(blisp_interp* b, const char* name, blisp_value* v);
+
+//Free cycles reference counting missed. Only for interpreters created
+//with BLISP_GC, values the caller holds are kept. Does nothing from
+//inside a native function.
+BLISP_API void blisp_collect(blisp_interp* b);
+
+//Making values
+BLISP_API blisp_value* blisp_int(blisp_interp* b, long x);
+BLISP_API blisp_value* blisp_float(blisp_interp* b, double x);
+BLISP_API blisp_value* blisp_string(blisp_interp* b, const char* s);
+BLISP_API blisp_value* blisp_symbol(blisp_interp* b, const char* s);
+BLISP_API blisp_value* blisp_error(blisp_interp* b, const char* msg);
+BLISP_API blisp_value* blisp_list(blisp_interp* b);
+
+//Add v to the end of list, both are consumed. Returns the list, which
+//is a new one if list was shared with anything else.
+BLISP_API blisp_value* blisp_append(blisp_interp* b, blisp_value* list, blisp_value* v);
+
+BLISP_API void blisp_free(blisp_interp* b, blisp_value* v);
+
+//Reading values, these never allocate
+BLISP_API enum blisp_type blisp_type_of(blisp_value* v);
+
+//Store an integer that fits in a long, or any number as a double.
+//Return 0 and leave out alone if v is not such a number.
+BLISP_API int blisp_to_long(blisp_value* v, long* out);
+BLISP_API int blisp_to_double(blisp_value* v, double* out);
+
+//Text of a string, symbol or error, NULL for anything else. Valid while
+//v is.
+BLISP_API const char* blisp_to_string(blisp_value* v);
+
+//Elements of a list, borrowed from it
+BLISP_API int blisp_count(blisp_value* v);
+BLISP_API blisp_value* blisp_item(blisp_value* v, int i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
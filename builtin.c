@@ -1,14 +1,27 @@
+#include <limits.h>
+#include <math.h>
 #include "builtin.h"
+#include "alloc.h"
+#include "gc.h"
+#include "reader.h"
+#include "big.h"
+#include "vec.h"
+#include "pool.h"
 
 char* ltype_name(ltype_t type) {
   switch(type) {
     case LVAL_FUN: return "Function";
     case LVAL_NUM: return "Number";
+    case LVAL_DBL: return "Float";
+    case LVAL_BIG: return "Bignum";
     case LVAL_ERR: return "Error";
     case LVAL_SYM: return "Symbol";
     case LVAL_STR: return "String";
     case LVAL_SEXPR: return "S-Expression";
     case LVAL_QEXPR: return "Q-Expression";
+    case LVAL_MAP: return "Map";
+    case LVAL_VEC: return "Vector";
+    case LVAL_FUT: return "Future";
     default: return "Unknown";
   }
 }
@@ -20,10 +33,9 @@ lval* builtin_head(lenv* e, lval* a) {
   LASSERT_NOT_EMPTY("head", a, 0);
 
   lval* v = lval_take(a, 0);
-  while (v->count > 1) {
-    lval_del(lval_pop(v, 1));
-  }
-  return v;
+  lval* x = lval_add(lval_qexpr(), lval_copy(v->cell[0]));
+  lval_del(v);
+  return x;
 }
 
 //Return all but the first element in a list
@@ -32,7 +44,7 @@ lval* builtin_tail(lenv* e, lval* a) {
   LASSERT_TYPE("tail", a, 0, LVAL_QEXPR);
   LASSERT_NOT_EMPTY("tail", a, 0);
 
-  lval* v = lval_take(a, 0);
+  lval* v = lval_unshare(lval_take(a, 0));
   lval_del(lval_pop(v, 0));
   return v;
 }
@@ -43,13 +55,20 @@ lval* builtin_list(lenv* e, lval* a) {
   return a;
 }
 
-//Evaluate a list as an expression
-lval* builtin_eval(lenv* e, lval* a) {
+//Check the arguments to eval and return the list as an s-expression
+lval* builtin_eval_expr(lval* a) {
   LASSERT_NUM("eval", a, 1);
   LASSERT_TYPE("eval", a, 0, LVAL_QEXPR);
 
-  lval* x = lval_take(a, 0);
+  lval* x = lval_unshare(lval_take(a, 0));
   x->type = LVAL_SEXPR;
+  return x;
+}
+
+//Evaluate a list as an expression
+lval* builtin_eval(lenv* e, lval* a) {
+  lval* x = builtin_eval_expr(a);
+  if (x->type == LVAL_ERR) { return x; }
   return lval_eval(e, x);
 }
 
@@ -74,11 +93,9 @@ lval* builtin_cons(lenv* e, lval* a) {
   LASSERT_NUM("cons", a, 2);
   LASSERT_TYPE("cons", a, 1, LVAL_QEXPR);
 
-  lval* x = lval_qexpr();
-  x = lval_add(x, lval_pop(a, 0));
-  x = lval_join(x, lval_pop(a, 0));
-  lval_del(a);
-  return x;
+  lval* x = lval_pop(a, 0);
+  lval* v = lval_unshare(lval_take(a, 0));
+  return lval_prepend(v, x);
 }
 
 lval* builtin_len(lenv* e, lval* a) {
@@ -95,8 +112,351 @@ lval* builtin_init(lenv* e, lval* a) {
   LASSERT_TYPE("init", a, 0, LVAL_QEXPR);
   LASSERT_NOT_EMPTY("init", a, 0);
 
-  lval* x = lval_take(a, 0);
-  lval_pop(x, x->count-1);
+  lval* x = lval_unshare(lval_take(a, 0));
+  lval_del(lval_pop(x, x->count-1));
+  return x;
+}
+
+//Take ownership of the cells of a list so they can be moved out or
+//replaced in place, copying the cell buffer only if it is shared
+static lval* lval_own(lval* l) {
+  l = lval_unshare(l);
+  return lval_reserve(l, l->count);
+}
+
+//Call f with one or two arguments, the arguments are consumed
+static lval* lval_call1(lenv* e, lval* f, lval* x) {
+  return lval_call(e, f, lval_add(lval_sexpr(), x));
+}
+
+static lval* lval_call2(lenv* e, lval* f, lval* x, lval* y) {
+  return lval_call(e, f, lval_add(lval_add(lval_sexpr(), x), y));
+}
+
+#define LASSERT_HOF(func, args, num) \
+  LASSERT_NUM(func, args, num) \
+  LASSERT_TYPE(func, args, 0, LVAL_FUN) \
+  LASSERT_TYPE(func, args, num-1, LVAL_QEXPR)
+
+//Apply f to each element, replacing it in the list
+lval* builtin_map(lenv* e, lval* a) {
+  LASSERT_HOF("map", a, 2);
+
+  lval* l = lval_own(lval_pop(a, 1));
+  lval* f = lval_take(a, 0);
+  for (int i = 0; i < l->count; i++) {
+    lval* x = l->cell[i];
+    l->cell[i] = NULL;
+    x = lval_call1(e, f, x);
+    if (x->type == LVAL_ERR) {
+      lval_del(l); lval_del(f);
+      return x;
+    }
+    l->cell[i] = x;
+  }
+  lval_del(f);
+  return l;
+}
+
+//Keep the elements f returns true for, moving them down over the others
+lval* builtin_filter(lenv* e, lval* a) {
+  LASSERT_HOF("filter", a, 2);
+
+  lval* l = lval_own(lval_pop(a, 1));
+  lval* f = lval_take(a, 0);
+  int kept = 0;
+  for (int i = 0; i < l->count; i++) {
+    lval* x = lval_call1(e, f, lval_copy(l->cell[i]));
+    if (x->type != LVAL_NUM) {
+      lval* err = x->type == LVAL_ERR ? x : lval_err(
+          "Function filter passed a function returning %s, Expected Number.",
+          ltype_name(x->type));
+      if (err != x) { lval_del(x); }
+      lval_del(l); lval_del(f);
+      return err;
+    }
+
+    lval* y = l->cell[i];
+    l->cell[i] = NULL;
+    if (x->num) { l->cell[kept++] = y; } else { lval_del(y); }
+    lval_del(x);
+  }
+  lval_del(f);
+  return lval_resize(l, kept);
+}
+
+//Fold from the left, f is called with the accumulator and then the element
+lval* builtin_foldl(lenv* e, lval* a) {
+  LASSERT_HOF("foldl", a, 3);
+
+  lval* l = lval_own(lval_pop(a, 2));
+  lval* z = lval_pop(a, 1);
+  lval* f = lval_take(a, 0);
+  for (int i = 0; i < l->count && z->type != LVAL_ERR; i++) {
+    lval* x = l->cell[i];
+    l->cell[i] = NULL;
+    z = lval_call2(e, f, z, x);
+  }
+  lval_del(l); lval_del(f);
+  return z;
+}
+
+//Fold from the right, f is called with the element and then the accumulator
+lval* builtin_foldr(lenv* e, lval* a) {
+  LASSERT_HOF("foldr", a, 3);
+
+  lval* l = lval_own(lval_pop(a, 2));
+  lval* z = lval_pop(a, 1);
+  lval* f = lval_take(a, 0);
+  for (int i = l->count-1; i >= 0 && z->type != LVAL_ERR; i--) {
+    lval* x = l->cell[i];
+    l->cell[i] = NULL;
+    z = lval_call2(e, f, x, z);
+  }
+  lval_del(l); lval_del(f);
+  return z;
+}
+
+lval* builtin_reverse(lenv* e, lval* a) {
+  LASSERT_NUM("reverse", a, 1);
+  LASSERT_TYPE("reverse", a, 0, LVAL_QEXPR);
+
+  lval* l = lval_own(lval_take(a, 0));
+  for (int i = 0, j = l->count-1; i < j; i++, j--) {
+    lval* t = l->cell[i];
+    l->cell[i] = l->cell[j];
+    l->cell[j] = t;
+  }
+  return l;
+}
+
+//Return the element at index n
+lval* builtin_nth(lenv* e, lval* a) {
+  LASSERT_NUM("nth", a, 2);
+  LASSERT_TYPE("nth", a, 0, LVAL_NUM);
+  LASSERT_TYPE("nth", a, 1, LVAL_QEXPR);
+
+  long n = a->cell[0]->num;
+  LASSERT(a, n >= 0 && n < a->cell[1]->count,
+      "Function nth passed index %li out of range for a list of %i.", n, a->cell[1]->count);
+
+  lval* x = lval_copy(a->cell[1]->cell[n]);
+  lval_del(a);
+  return x;
+}
+
+//Comparison for sort. Once it has failed no more calls are made, so the
+//sort runs to the end with every element still held once.
+struct lsort {
+  lenv* e;
+  lval* f;
+  lval* err;
+};
+
+//Check whether y comes before x
+static int lsort_before(struct lsort* s, lval* y, lval* x) {
+  if (s->err) { return 0; }
+
+  lval* r = lval_call2(s->e, s->f, lval_copy(y), lval_copy(x));
+  if (r->type != LVAL_NUM) {
+    s->err = r->type == LVAL_ERR ? r : lval_err(
+        "Function sort passed a function returning %s, Expected Number.",
+        ltype_name(r->type));
+    if (s->err != r) { lval_del(r); }
+    return 0;
+  }
+  int before = r->num != 0;
+  lval_del(r);
+  return before;
+}
+
+//Merge sort the n cells at c using tmp, which has room for n. Elements
+//from the right half only go first if they are strictly before, which
+//keeps equal elements in order.
+static void lsort_merge(struct lsort* s, lval** c, lval** tmp, int n) {
+  if (n < 2) { return; }
+  int h = n / 2;
+  lsort_merge(s, c, tmp, h);
+  lsort_merge(s, c + h, tmp, n - h);
+
+  memcpy(tmp, c, sizeof(lval*) * h);
+  int i = 0, j = h, k = 0;
+  while (i < h && j < n) {
+    if (lsort_before(s, c[j], tmp[i])) { c[k++] = c[j++]; } else { c[k++] = tmp[i++]; }
+  }
+  while (i < h) { c[k++] = tmp[i++]; }
+}
+
+//Stable sort with f, which is given two elements and returns true if the
+//first belongs before the second
+lval* builtin_sort(lenv* e, lval* a) {
+  LASSERT_HOF("sort", a, 2);
+
+  lval* l = lval_own(lval_pop(a, 1));
+  struct lsort s = { e, lval_take(a, 0), NULL };
+  if (l->count > 1) {
+    lval** tmp = malloc(sizeof(lval*) * (l->count / 2));
+    lsort_merge(&s, l->cell, tmp, l->count);
+    free(tmp);
+  }
+  lval_del(s.f);
+  if (s.err) {
+    lval_del(l);
+    return s.err;
+  }
+  return l;
+}
+
+//Map f over a list on the worker pool, see pool.h. Results are in the
+//order of the list whichever thread worked each one out.
+lval* builtin_pmap(lenv* e, lval* a) {
+  LASSERT_HOF("pmap", a, 2);
+
+  lval* x = pool_map(e, a->cell[0], a->cell[1]);
+  lval_del(a);
+  return x;
+}
+
+//Fold a list with an associative f on the worker pool. Runs of the list
+//are folded in parallel, then their results are folded in order from z.
+lval* builtin_preduce(lenv* e, lval* a) {
+  LASSERT_HOF("preduce", a, 3);
+  if (a->cell[2]->count == 0) { return builtin_foldl(e, a); }
+
+  lval* parts = pool_reduce(e, a->cell[0], a->cell[2]);
+  if (parts->type == LVAL_ERR) {
+    lval_del(a);
+    return parts;
+  }
+  lval_del(lval_pop(a, 2));
+  return builtin_foldl(e, lval_add(a, parts));
+}
+
+//Call a function with the rest of the arguments on a worker thread,
+//returning a future for its result
+lval* builtin_spawn(lenv* e, lval* a) {
+  LASSERT(a, a->count > 0, "Function spawn passed no arguments.");
+  LASSERT_TYPE("spawn", a, 0, LVAL_FUN);
+
+  lval* x = pool_spawn(e, a);
+  lval_del(a);
+  return x;
+}
+
+lval* builtin_await(lenv* e, lval* a) {
+  LASSERT_NUM("await", a, 1);
+  LASSERT_TYPE("await", a, 0, LVAL_FUT);
+
+  lval* x = pool_await(a->cell[0]->fut);
+  lval_del(a);
+  return x;
+}
+
+//Wait for a list of futures, returning their results in order or the
+//error of the first that gave one
+lval* builtin_await_all(lenv* e, lval* a) {
+  LASSERT_NUM("await-all", a, 1);
+  LASSERT_TYPE("await-all", a, 0, LVAL_QEXPR);
+
+  lval* l = a->cell[0];
+  for (int i = 0; i < l->count; i++) {
+    LASSERT(a, l->cell[i]->type == LVAL_FUT,
+        "Function await-all passed incorrect type for element %i. Got %s, Expected %s",
+        i, ltype_name(l->cell[i]->type), ltype_name(LVAL_FUT));
+  }
+
+  lval* x = lval_reserve(lval_qexpr(), l->count);
+  for (int i = 0; i < l->count; i++) {
+    lval* y = pool_await(l->cell[i]->fut);
+    if (y->type == LVAL_ERR) {
+      lval_del(x);
+      x = y;
+      break;
+    }
+    x = lval_add(x, y);
+  }
+  lval_del(a);
+  return x;
+}
+
+//Build a map from a list of alternating keys and values
+lval* builtin_map_new(lenv* e, lval* a) {
+  LASSERT_NUM("map-new", a, 1);
+  LASSERT_TYPE("map-new", a, 0, LVAL_QEXPR);
+
+  lval* kvs = a->cell[0];
+  LASSERT(a, kvs->count % 2 == 0,
+      "Function map-new passed a key without a value. Got %i items, Expected an even number.",
+      kvs->count);
+  for (int i = 0; i < kvs->count; i += 2) {
+    LASSERT(a, lval_hashable(kvs->cell[i]),
+        "Function map-new passed unhashable key at %i. Got %s, Expected Number, Symbol or String.",
+        i, ltype_name(kvs->cell[i]->type));
+  }
+
+  lval* m = lval_map();
+  for (int i = 0; i < kvs->count; i += 2) {
+    m = lval_map_put(m, lval_copy(kvs->cell[i]), lval_copy(kvs->cell[i+1]));
+  }
+  lval_del(a);
+  return m;
+}
+
+//Look up a key, giving the optional third argument if it is not bound
+lval* builtin_map_get(lenv* e, lval* a) {
+  LASSERT(a, a->count == 2 || a->count == 3,
+      "Function map-get passed incorrect number of arguments. Got %i, Expected 2 or 3.",
+      a->count);
+  LASSERT_TYPE("map-get", a, 0, LVAL_MAP);
+  LASSERT_KEY("map-get", a, 1);
+
+  lval* x = lval_map_get(a->cell[0], a->cell[1]);
+  if (x) {
+    x = lval_copy(x);
+  } else if (a->count == 3) {
+    x = lval_pop(a, 2);
+  } else {
+    x = lval_err("Function map-get passed a key that is not in the map.");
+  }
+  lval_del(a);
+  return x;
+}
+
+lval* builtin_map_put(lenv* e, lval* a) {
+  LASSERT_NUM("map-put", a, 3);
+  LASSERT_TYPE("map-put", a, 0, LVAL_MAP);
+  LASSERT_KEY("map-put", a, 1);
+
+  lval* v = lval_pop(a, 2);
+  lval* k = lval_pop(a, 1);
+  lval* m = lval_unshare(lval_take(a, 0));
+  return lval_map_put(m, k, v);
+}
+
+lval* builtin_map_del(lenv* e, lval* a) {
+  LASSERT_NUM("map-del", a, 2);
+  LASSERT_TYPE("map-del", a, 0, LVAL_MAP);
+  LASSERT_KEY("map-del", a, 1);
+
+  lval* k = lval_pop(a, 1);
+  lval* m = lval_take(a, 0);
+  //A shared map is only copied if there is something to remove
+  if (lval_map_get(m, k)) { m = lval_map_del(lval_unshare(m), k); }
+  lval_del(k);
+  return m;
+}
+
+//Return the keys of a map in the order they were added
+lval* builtin_map_keys(lenv* e, lval* a) {
+  LASSERT_NUM("map-keys", a, 1);
+  LASSERT_TYPE("map-keys", a, 0, LVAL_MAP);
+
+  lval* m = lval_take(a, 0);
+  lval* x = lval_reserve(lval_qexpr(), HASH_COUNT(m->map));
+  for (struct lentry* en = m->map; en; en = en->hh.next) {
+    x = lval_add(x, lval_copy(en->key));
+  }
+  lval_del(m);
   return x;
 }
 
@@ -128,6 +488,7 @@ lval* builtin_put(lenv* e, lval* a) { return builtin_var(e, a, "="); }
 
 lval* builtin_env(lenv* e, lval* a) {
   lenv_iter(e);
+  lval_del(a);
   return lval_sexpr();
 }
 
@@ -152,60 +513,180 @@ lval* builtin_lambda(lenv* e, lval* a) {
 }
 
 
-lval* builtin_gt(lenv*e, lval* a) { return builtin_ord(e, a, ">"); }
-lval* builtin_lt(lenv*e, lval* a) { return builtin_ord(e, a, "<"); }
-lval* builtin_ge(lenv*e, lval* a) { return builtin_ord(e, a, ">="); }
-lval* builtin_le(lenv*e, lval* a) { return builtin_ord(e, a, "<="); }
+//Widest representation among numeric arguments, arithmetic is done in
+//it. Bignums only hold values outside the range of long, so a result
+//that overflows a long is worked out again in bignums.
+enum { LNUM_INT, LNUM_BIG, LNUM_DBL };
 
-lval* builtin_ord(lenv* e, lval* a, char* op) {
-  LASSERT_NUM(op, a, 2);
-  LASSERT_TYPE(op, a, 0, LVAL_NUM);
-  LASSERT_TYPE(op, a, 1, LVAL_NUM);
+static int lval_num_kind(lval* a) {
+  int kind = LNUM_INT;
+  for (int i = 0; i < a->count; i++) {
+    if (a->cell[i]->type == LVAL_DBL) { return LNUM_DBL; }
+    if (a->cell[i]->type == LVAL_BIG) { kind = LNUM_BIG; }
+  }
+  return kind;
+}
 
+static int lval_is_int(lval* a) {
+  for (int i = 0; i < a->count; i++) {
+    if (a->cell[i]->type != LVAL_NUM) { return 0; }
+  }
+  return 1;
+}
+
+static double lval_to_dbl(lval* v) {
+  if (v->type == LVAL_DBL) { return v->dbl; }
+  if (v->type == LVAL_BIG) { return big_to_dbl(v->big); }
+  return (double)v->num;
+}
+
+static int lval_eq_zero(lval* v) {
+  if (v->type == LVAL_DBL) { return v->dbl == 0; }
+  return v->type == LVAL_NUM && v->num == 0;
+}
+
+static struct lbig* lval_to_big(lval* v) {
+  return v->type == LVAL_BIG ? big_copy(v->big) : big_from_long(v->num);
+}
+
+static int lval_big_cmp(lval* x, lval* y) {
+  struct lbig* bx = lval_to_big(x);
+  struct lbig* by = lval_to_big(y);
+  int c = big_cmp(bx, by);
+  big_del(bx);
+  big_del(by);
+  return c;
+}
+
+//Fold integer arguments with f in bignums
+static lval* builtin_big_fold(lval* a, struct lbig* (*f)(struct lbig*, struct lbig*)) {
+  struct lbig* x = lval_to_big(a->cell[0]);
+  for (int i = 1; i < a->count; i++) {
+    struct lbig* y = lval_to_big(a->cell[i]);
+    struct lbig* r = f(x, y);
+    big_del(x);
+    big_del(y);
+    x = r;
+  }
+  lval_del(a);
+  return lval_big(x);
+}
+
+//Comparisons and arithmetic each have their own loop over the arguments,
+//which are read in place rather than popped
+lval* builtin_gt(lenv* e, lval* a) {
+  LASSERT_ORD(">", a);
   int r;
-  if (strcmp(op, ">") == 0) { r = a->cell[0]->num > a->cell[1]->num; }
-  if (strcmp(op, "<") == 0) { r = a->cell[0]->num < a->cell[1]->num; }
-  if (strcmp(op, ">=") == 0) { r = a->cell[0]->num >= a->cell[1]->num; }
-  if (strcmp(op, "<=") == 0) { r = a->cell[0]->num <= a->cell[1]->num; }
+  if (lval_is_int(a)) {
+    r = a->cell[0]->num > a->cell[1]->num;
+  } else if (lval_num_kind(a) == LNUM_DBL) {
+    r = lval_to_dbl(a->cell[0]) > lval_to_dbl(a->cell[1]);
+  } else {
+    int c = lval_big_cmp(a->cell[0], a->cell[1]);
+    r = c > 0;
+  }
+  lval_del(a);
+  return lval_num(r);
+}
 
+lval* builtin_lt(lenv* e, lval* a) {
+  LASSERT_ORD("<", a);
+  int r;
+  if (lval_is_int(a)) {
+    r = a->cell[0]->num < a->cell[1]->num;
+  } else if (lval_num_kind(a) == LNUM_DBL) {
+    r = lval_to_dbl(a->cell[0]) < lval_to_dbl(a->cell[1]);
+  } else {
+    int c = lval_big_cmp(a->cell[0], a->cell[1]);
+    r = c < 0;
+  }
   lval_del(a);
   return lval_num(r);
 }
 
-lval* builtin_eq(lenv* e, lval* a) { return builtin_cmp(e, a, "=="); }
-lval* builtin_ne(lenv* e, lval* a) { return builtin_cmp(e, a, "!="); }
+lval* builtin_ge(lenv* e, lval* a) {
+  LASSERT_ORD(">=", a);
+  int r;
+  if (lval_is_int(a)) {
+    r = a->cell[0]->num >= a->cell[1]->num;
+  } else if (lval_num_kind(a) == LNUM_DBL) {
+    r = lval_to_dbl(a->cell[0]) >= lval_to_dbl(a->cell[1]);
+  } else {
+    int c = lval_big_cmp(a->cell[0], a->cell[1]);
+    r = c >= 0;
+  }
+  lval_del(a);
+  return lval_num(r);
+}
 
-lval* builtin_cmp(lenv* e, lval* a, char* op) {
-  LASSERT_NUM(op, a, 2);
+lval* builtin_le(lenv* e, lval* a) {
+  LASSERT_ORD("<=", a);
   int r;
-  if (strcmp(op, "==") == 0) { r = lval_eq(a->cell[0], a->cell[1]); }
-  if (strcmp(op, "!=") == 0) { r = !lval_eq(a->cell[0], a->cell[1]); }
+  if (lval_is_int(a)) {
+    r = a->cell[0]->num <= a->cell[1]->num;
+  } else if (lval_num_kind(a) == LNUM_DBL) {
+    r = lval_to_dbl(a->cell[0]) <= lval_to_dbl(a->cell[1]);
+  } else {
+    int c = lval_big_cmp(a->cell[0], a->cell[1]);
+    r = c <= 0;
+  }
   lval_del(a);
   return lval_num(r);
 }
 
-lval* builtin_if(lenv* e, lval* a) {
+lval* builtin_eq(lenv* e, lval* a) {
+  LASSERT_NUM("==", a, 2);
+  int r = lval_eq(a->cell[0], a->cell[1]);
+  lval_del(a);
+  return lval_num(r);
+}
+
+lval* builtin_ne(lenv* e, lval* a) {
+  LASSERT_NUM("!=", a, 2);
+  int r = !lval_eq(a->cell[0], a->cell[1]);
+  lval_del(a);
+  return lval_num(r);
+}
+
+//Check the arguments to if and return the selected branch as an s-expression
+lval* builtin_if_branch(lval* a) {
   LASSERT_NUM("if", a, 3);
   LASSERT_TYPE("if", a, 0, LVAL_NUM);
   LASSERT_TYPE("if", a, 1, LVAL_QEXPR);
   LASSERT_TYPE("if", a, 2, LVAL_QEXPR);
 
-  //Make both expressions evaluatable
+  //Select a branch and make it evaluatable
   lval* x;
-  a->cell[1]->type = LVAL_SEXPR;
-  a->cell[2]->type = LVAL_SEXPR;
-
   if (a->cell[0]->num) {
-    x = lval_eval(e, lval_pop(a, 1));
+    x = lval_unshare(lval_pop(a, 1));
   } else {
-    x = lval_eval(e, lval_pop(a, 2));
+    x = lval_unshare(lval_pop(a, 2));
   }
+  x->type = LVAL_SEXPR;
+
   lval_del(a);
   return x;
 }
 
-lval* builtin_and(lenv* e, lval* a) { return builtin_logic(e, a, "&&"); }
-lval* builtin_or(lenv* e, lval* a) { return builtin_logic(e, a, "||"); }
+lval* builtin_if(lenv* e, lval* a) {
+  lval* x = builtin_if_branch(a);
+  if (x->type == LVAL_ERR) { return x; }
+  return lval_eval(e, x);
+}
+
+lval* builtin_and(lenv* e, lval* a) {
+  LASSERT_LOGIC("&&", a);
+  int r = a->cell[0]->num && a->cell[1]->num;
+  lval_del(a);
+  return lval_num(r);
+}
+
+lval* builtin_or(lenv* e, lval* a) {
+  LASSERT_LOGIC("||", a);
+  int r = a->cell[0]->num || a->cell[1]->num;
+  lval_del(a);
+  return lval_num(r);
+}
 
 lval* builtin_not(lenv* e, lval* a) {
   LASSERT_NUM("!", a, 1);
@@ -216,116 +697,534 @@ lval* builtin_not(lenv* e, lval* a) {
   return lval_num(r);
 }
 
-lval* builtin_logic(lenv* e, lval* a, char* op) {
-  LASSERT_NUM(op, a, 2);
-  LASSERT_TYPE(op, a, 0, LVAL_NUM);
-  LASSERT_TYPE(op, a, 1, LVAL_NUM);
+//Arithmetic folds left over its arguments. Integers are tried first and
+//the fold is started again in bignums if any step overflows.
+lval* builtin_add(lenv* e, lval* a) {
+  LASSERT_NUMS("+", a);
+  int kind = lval_num_kind(a);
+  if (kind == LNUM_DBL) {
+    double x = lval_to_dbl(a->cell[0]);
+    for (int i = 1; i < a->count; i++) { x += lval_to_dbl(a->cell[i]); }
+    lval_del(a);
+    return lval_dbl(x);
+  }
 
-  int r;
-  if (strcmp(op, "&&") == 0) { r = a->cell[0]->num && a->cell[1]->num; }
-  if (strcmp(op, "||") == 0) { r = a->cell[0]->num || a->cell[1]->num; }
-  lval_del(a);
-  return lval_num(r);
+  if (kind == LNUM_INT) {
+    long x = a->cell[0]->num;
+    int i;
+    for (i = 1; i < a->count; i++) {
+      if (__builtin_add_overflow(x, a->cell[i]->num, &x)) { break; }
+    }
+    if (i == a->count) {
+      lval_del(a);
+      return lval_num(x);
+    }
+  }
+  return builtin_big_fold(a, big_add);
 }
 
-lval* builtin_add(lenv* e, lval* a) { return builtin_op(e, a, "+"); }
-lval* builtin_sub(lenv* e, lval* a) { return builtin_op(e, a, "-"); }
-lval* builtin_mul(lenv* e, lval* a) { return builtin_op(e, a, "*"); }
-lval* builtin_pow(lenv* e, lval* a) { return builtin_op(e, a, "^"); }
-lval* builtin_div(lenv* e, lval* a) { return builtin_op(e, a, "/"); }
-lval* builtin_mod(lenv* e, lval* a) { return builtin_op(e, a, "%"); }
+lval* builtin_sub(lenv* e, lval* a) {
+  LASSERT_NUMS("-", a);
+  int kind = lval_num_kind(a);
+  if (kind == LNUM_DBL) {
+    double x = lval_to_dbl(a->cell[0]);
+    if (a->count == 1) { x = -x; }
+    for (int i = 1; i < a->count; i++) { x -= lval_to_dbl(a->cell[i]); }
+    lval_del(a);
+    return lval_dbl(x);
+  }
 
-//Compute builtin operators
-lval* builtin_op(lenv* e, lval* a, char* op) {
-  //Ensure all args are numbers
-  for (int i = 0; i < a->count; i++) {
-    if (a->cell[i]->type != LVAL_NUM) {
+  if (kind == LNUM_INT) {
+    long x = a->cell[0]->num;
+    int i = 1, ok = 1;
+
+    //Unary negation
+    if (a->count == 1) { ok = !__builtin_sub_overflow(0, x, &x); }
+    for (; ok && i < a->count; i++) {
+      ok = !__builtin_sub_overflow(x, a->cell[i]->num, &x);
+    }
+    if (ok) {
       lval_del(a);
-      return lval_err("Function %s cannot operate on non-number, argument %i", op, i);
+      return lval_num(x);
     }
   }
 
-  //Pop top of list
-  lval* x = lval_pop(a, 0);
+  if (a->count == 1) {
+    struct lbig* y = lval_to_big(a->cell[0]);
+    struct lbig* x = big_neg(y);
+    big_del(y);
+    lval_del(a);
+    return lval_big(x);
+  }
+  return builtin_big_fold(a, big_sub);
+}
 
-  //Unary negation
-  if ((strcmp(op, "-") == 0) && a->count == 0) { x->num = -x->num; }
-
-  //While list has elems, pop and process operators
-  while (a->count > 0) {
-    lval* y = lval_pop(a, 0);
-
-    if (strcmp(op, "+") == 0) { x->num += y->num; }
-    if (strcmp(op, "-") == 0) { x->num -= y->num; }
-    if (strcmp(op, "*") == 0) { x->num *= y->num; }
-    if (strcmp(op, "^") == 0) { x->num = pow(x->num, y->num); }
-    if (strcmp(op, "/") == 0) {
-      if (y->num == 0) {
-        lval_del(x);
-        lval_del(y);
-        return lval_err("Divide by zero.");
-      } else {
-        x->num /= y->num;
-      }
+lval* builtin_mul(lenv* e, lval* a) {
+  LASSERT_NUMS("*", a);
+  int kind = lval_num_kind(a);
+  if (kind == LNUM_DBL) {
+    double x = lval_to_dbl(a->cell[0]);
+    for (int i = 1; i < a->count; i++) { x *= lval_to_dbl(a->cell[i]); }
+    lval_del(a);
+    return lval_dbl(x);
+  }
+
+  if (kind == LNUM_INT) {
+    long x = a->cell[0]->num;
+    int i;
+    for (i = 1; i < a->count; i++) {
+      if (__builtin_mul_overflow(x, a->cell[i]->num, &x)) { break; }
     }
-    if (strcmp(op, "%") == 0) {
-      if (y->num == 0) {
-        lval_del(x);
-        lval_del(y);
-        return lval_err("Divide by zero.");
-      } else {
-        x->num %= y->num;
+    if (i == a->count) {
+      lval_del(a);
+      return lval_num(x);
+    }
+  }
+  return builtin_big_fold(a, big_mul);
+}
+
+//Integer division and remainder, bignum divisors are never zero
+lval* builtin_div(lenv* e, lval* a) {
+  LASSERT_NUMS("/", a);
+  for (int i = 1; i < a->count; i++) {
+    LASSERT(a, !lval_eq_zero(a->cell[i]), "Divide by zero.");
+  }
+
+  int kind = lval_num_kind(a);
+  if (kind == LNUM_DBL) {
+    double x = lval_to_dbl(a->cell[0]);
+    for (int i = 1; i < a->count; i++) { x /= lval_to_dbl(a->cell[i]); }
+    lval_del(a);
+    return lval_dbl(x);
+  }
+
+  if (kind == LNUM_INT) {
+    long x = a->cell[0]->num;
+    int i;
+    for (i = 1; i < a->count; i++) {
+      long y = a->cell[i]->num;
+      if (x == LONG_MIN && y == -1) { break; }
+      x /= y;
+    }
+    if (i == a->count) {
+      lval_del(a);
+      return lval_num(x);
+    }
+  }
+  return builtin_big_fold(a, big_div);
+}
+
+lval* builtin_mod(lenv* e, lval* a) {
+  LASSERT_NUMS("%", a);
+  for (int i = 1; i < a->count; i++) {
+    LASSERT(a, !lval_eq_zero(a->cell[i]), "Divide by zero.");
+  }
+
+  int kind = lval_num_kind(a);
+  if (kind == LNUM_DBL) {
+    double x = lval_to_dbl(a->cell[0]);
+    for (int i = 1; i < a->count; i++) { x = fmod(x, lval_to_dbl(a->cell[i])); }
+    lval_del(a);
+    return lval_dbl(x);
+  }
+
+  if (kind == LNUM_INT) {
+    long x = a->cell[0]->num;
+    for (int i = 1; i < a->count; i++) {
+      long y = a->cell[i]->num;
+      //LONG_MIN % -1 traps on some machines, the remainder is always 0
+      x = y == -1 ? 0 : x % y;
+    }
+    lval_del(a);
+    return lval_num(x);
+  }
+  return builtin_big_fold(a, big_mod);
+}
+
+//Integer power by squaring. Floats and negative exponents, whose result
+//is a fraction, go through pow.
+lval* builtin_pow(lenv* e, lval* a) {
+  LASSERT_NUMS("^", a);
+  int kind = lval_num_kind(a);
+  int frac = kind == LNUM_DBL;
+  for (int i = 1; i < a->count && !frac; i++) {
+    lval* y = a->cell[i];
+    frac = y->type == LVAL_BIG ? y->big->neg : y->num < 0;
+  }
+  if (frac) {
+    double x = lval_to_dbl(a->cell[0]);
+    for (int i = 1; i < a->count; i++) {
+      double y = lval_to_dbl(a->cell[i]);
+      LASSERT(a, x != 0 || y >= 0, "Divide by zero.");
+      x = pow(x, y);
+    }
+    lval_del(a);
+    return lval_dbl(x);
+  }
+
+  //Exponents that are bignums could only give a result that fits for a
+  //base of 0, 1 or -1
+  for (int i = 1; i < a->count; i++) {
+    LASSERT_RANGE("^", a, a->cell[i]->type == LVAL_NUM);
+  }
+
+  if (kind == LNUM_INT) {
+    long x = a->cell[0]->num;
+    int i, ok = 1;
+    for (i = 1; ok && i < a->count; i++) {
+      long y = a->cell[i]->num;
+      long r = 1;
+      long b = x;
+      while (ok && y) {
+        if (y & 1) { ok = !__builtin_mul_overflow(r, b, &r); }
+        y >>= 1;
+        if (ok && y) { ok = !__builtin_mul_overflow(b, b, &b); }
       }
+      x = r;
+    }
+    if (ok) {
+      lval_del(a);
+      return lval_num(x);
     }
+  }
 
-    //Done with elem, remove
-    lval_del(y);
+  struct lbig* x = lval_to_big(a->cell[0]);
+  for (int i = 1; i < a->count; i++) {
+    struct lbig* r = big_pow(x, a->cell[i]->num);
+    big_del(x);
+    x = r;
   }
+  lval_del(a);
+  return lval_big(x);
+}
+
+//Apply a function of one number, giving a float
+static lval* builtin_math(lval* a, char* func, double (*f)(double)) {
+  LASSERT_NUM(func, a, 1);
+  LASSERT_NUMS(func, a);
 
-  //Remove input expression and return result
+  double x = f(lval_to_dbl(a->cell[0]));
   lval_del(a);
-  return x;
+  return lval_dbl(x);
 }
 
-lval* builtin_load(lenv* e, lval* a) {
-  LASSERT_NUM("load", a, 1);
-  LASSERT_TYPE("load", a, 0, LVAL_STR);
+lval* builtin_sqrt(lenv* e, lval* a) { return builtin_math(a, "sqrt", sqrt); }
+lval* builtin_exp(lenv* e, lval* a) { return builtin_math(a, "exp", exp); }
+lval* builtin_log(lenv* e, lval* a) { return builtin_math(a, "log", log); }
+lval* builtin_sin(lenv* e, lval* a) { return builtin_math(a, "sin", sin); }
+lval* builtin_cos(lenv* e, lval* a) { return builtin_math(a, "cos", cos); }
 
-  //Parse file given by string as filename
-  mpc_result_t r;
-  if (mpc_parse_contents(a->cell[0]->str, blisp, &r)) {
-    //Read Contents
-    lval* expr = lval_read(r.output);
-    mpc_ast_delete(r.output);
-
-    //Evaluate expressions on stack
-    while (expr->count) {
-      lval* x = lval_eval(e, lval_pop(expr, 0));
-      if (x->type == LVAL_ERR) {
-        lval_println(x);
-      }
-      lval_del(x);
+//Round a number to an integer with f
+static lval* builtin_round_by(lval* a, char* func, double (*f)(double)) {
+  LASSERT_NUM(func, a, 1);
+  LASSERT_NUMS(func, a);
+  if (a->cell[0]->type != LVAL_DBL) { return lval_take(a, 0); }
+
+  double x = f(a->cell[0]->dbl);
+  LASSERT_RANGE(func, a, isfinite(x));
+  lval_del(a);
+  if (x >= -9223372036854775808.0 && x < 9223372036854775808.0) { return lval_num((long)x); }
+  return lval_big(big_from_dbl(x));
+}
+
+lval* builtin_floor(lenv* e, lval* a) { return builtin_round_by(a, "floor", floor); }
+lval* builtin_ceil(lenv* e, lval* a) { return builtin_round_by(a, "ceil", ceil); }
+lval* builtin_round(lenv* e, lval* a) { return builtin_round_by(a, "round", round); }
+
+//Vector functions. The loops over the numbers are the kernels in vec.c,
+//a vector of ints is worked on as floats if the other operand is one.
+
+#define LASSERT_VEC(func, args, index) \
+  LASSERT_TYPE(func, args, index, LVAL_VEC)
+
+//Floats of a vector, a copy the caller frees if it held ints
+static double* vec_dbls(lval* v) {
+  if (v->vdbl) { return v->dbls; }
+  double* d = malloc(sizeof(double) * (v->vlen ? v->vlen : 1));
+  for (long i = 0; i < v->vlen; i++) { d[i] = (double)v->ints[i]; }
+  return d;
+}
+
+//Vector for an elementwise result, reusing the first argument's storage
+//when nothing else refers to it
+static lval* vec_result(lval* a, int dbl) {
+  lval* v = a->cell[0];
+  if (v->refs == 1 && v->vdbl == dbl) { return lval_copy(v); }
+  return lval_vec(v->vlen, dbl);
+}
+
+//Add a bignum into a running total, consuming both
+static struct lbig* big_add_into(struct lbig* acc, struct lbig* x) {
+  struct lbig* r = big_add(acc, x);
+  big_del(acc);
+  big_del(x);
+  return r;
+}
+
+//Exact sum of the products a[i]*b[i], or of a[i] if b is NULL. Partial
+//sums are kept in a long and moved into a bignum when they would overflow.
+static lval* vec_big_sum(int64_t* a, int64_t* b, long n) {
+  struct lbig* acc = big_from_long(0);
+  long s = 0, p, t;
+  for (long i = 0; i < n; i++) {
+    if (b && __builtin_mul_overflow(a[i], b[i], &p)) {
+      struct lbig* x = big_from_long(a[i]);
+      struct lbig* y = big_from_long(b[i]);
+      acc = big_add_into(acc, big_mul(x, y));
+      big_del(x);
+      big_del(y);
+      continue;
+    }
+    if (!b) { p = a[i]; }
+    if (__builtin_add_overflow(s, p, &t)) {
+      acc = big_add_into(acc, big_from_long(s));
+      s = p;
+    } else {
+      s = t;
     }
+  }
+  return lval_big(big_add_into(acc, big_from_long(s)));
+}
 
-    //Delete expression and args
-    lval_del(expr);
+//Build a vector from a list of numbers, floats if any of them is one
+lval* builtin_vec(lenv* e, lval* a) {
+  LASSERT_NUM("vec", a, 1);
+  LASSERT_TYPE("vec", a, 0, LVAL_QEXPR);
+
+  lval* xs = a->cell[0];
+  int dbl = 0;
+  for (int i = 0; i < xs->count; i++) {
+    LASSERT(a, xs->cell[i]->type == LVAL_NUM || xs->cell[i]->type == LVAL_DBL,
+        "Function vec passed non-number at %i. Got %s, Expected Number or Float.",
+        i, ltype_name(xs->cell[i]->type));
+    if (xs->cell[i]->type == LVAL_DBL) { dbl = 1; }
+  }
+
+  lval* v = lval_vec(xs->count, dbl);
+  for (int i = 0; i < xs->count; i++) {
+    if (dbl) { v->dbls[i] = lval_to_dbl(xs->cell[i]); } else { v->ints[i] = xs->cell[i]->num; }
+  }
+  lval_del(a);
+  return v;
+}
+
+//Vector of the integers from 0 up to n
+lval* builtin_vec_range(lenv* e, lval* a) {
+  LASSERT_NUM("vec-range", a, 1);
+  LASSERT_TYPE("vec-range", a, 0, LVAL_NUM);
+  LASSERT(a, a->cell[0]->num >= 0,
+      "Function vec-range passed negative length %li.", a->cell[0]->num);
+
+  lval* v = lval_vec(a->cell[0]->num, 0);
+  for (long i = 0; i < v->vlen; i++) { v->ints[i] = i; }
+  lval_del(a);
+  return v;
+}
+
+//Return the numbers of a vector as a list
+lval* builtin_vec_list(lenv* e, lval* a) {
+  LASSERT_NUM("vec-list", a, 1);
+  LASSERT_VEC("vec-list", a, 0);
+  LASSERT(a, a->cell[0]->vlen <= INT_MAX,
+      "Function vec-list passed a vector too long for a list.");
+
+  lval* v = lval_take(a, 0);
+  lval* x = lval_reserve(lval_qexpr(), v->vlen);
+  for (long i = 0; i < v->vlen; i++) {
+    x = lval_add(x, v->vdbl ? lval_dbl(v->dbls[i]) : lval_num(v->ints[i]));
+  }
+  lval_del(v);
+  return x;
+}
+
+lval* builtin_vec_len(lenv* e, lval* a) {
+  LASSERT_NUM("vec-len", a, 1);
+  LASSERT_VEC("vec-len", a, 0);
+
+  long x = a->cell[0]->vlen;
+  lval_del(a);
+  return lval_num(x);
+}
+
+lval* builtin_vec_get(lenv* e, lval* a) {
+  LASSERT_NUM("vec-get", a, 2);
+  LASSERT_VEC("vec-get", a, 0);
+  LASSERT_TYPE("vec-get", a, 1, LVAL_NUM);
+
+  lval* v = a->cell[0];
+  long i = a->cell[1]->num;
+  LASSERT(a, i >= 0 && i < v->vlen,
+      "Function vec-get passed index %li out of range for a vector of %li.", i, v->vlen);
+
+  lval* x = v->vdbl ? lval_dbl(v->dbls[i]) : lval_num(v->ints[i]);
+  lval_del(a);
+  return x;
+}
+
+//Check two vectors of the same length are given
+#define LASSERT_VECS(func, args) \
+  LASSERT_NUM(func, args, 2) \
+  LASSERT_VEC(func, args, 0) \
+  LASSERT_VEC(func, args, 1) \
+  LASSERT(args, args->cell[0]->vlen == args->cell[1]->vlen, \
+      "Function %s passed vectors of different lengths. Got %li and %li.", \
+      func, args->cell[0]->vlen, args->cell[1]->vlen)
+
+//Combine two vectors elementwise with the float or int kernel
+static lval* builtin_vec_zip(lval* a, char* func,
+    void (*fd)(double*, double*, double*, long),
+    int (*fi)(int64_t*, int64_t*, int64_t*, long)) {
+  LASSERT_VECS(func, a);
+
+  lval* x = a->cell[0];
+  lval* y = a->cell[1];
+  long n = x->vlen;
+  if (!x->vdbl && !y->vdbl) {
+    lval* r = vec_result(a, 0);
+    if (!fi(r->ints, x->ints, y->ints, n)) { lval_del(r); r = NULL; }
+    LASSERT_RANGE(func, a, r);
     lval_del(a);
+    return r;
+  }
 
-    //Return empty list
-    return lval_sexpr();
+  lval* r = vec_result(a, 1);
+  double* dx = vec_dbls(x);
+  double* dy = vec_dbls(y);
+  fd(r->dbls, dx, dy, n);
+  if (!x->vdbl) { free(dx); }
+  if (!y->vdbl) { free(dy); }
+  lval_del(a);
+  return r;
+}
 
+lval* builtin_vec_add(lenv* e, lval* a) { return builtin_vec_zip(a, "vec-add", vec_add_dbl, vec_add_int); }
+lval* builtin_vec_mul(lenv* e, lval* a) { return builtin_vec_zip(a, "vec-mul", vec_mul_dbl, vec_mul_int); }
+
+//Multiply each number in a vector by k
+lval* builtin_vec_scale(lenv* e, lval* a) {
+  LASSERT_NUM("vec-scale", a, 2);
+  LASSERT_VEC("vec-scale", a, 0);
+  LASSERT(a, a->cell[1]->type == LVAL_NUM || a->cell[1]->type == LVAL_DBL,
+      "Function 'vec-scale' passed incorrect type for argument 1. Got %s, Expected Number or Float",
+      ltype_name(a->cell[1]->type));
+
+  lval* v = a->cell[0];
+  lval* k = a->cell[1];
+  if (!v->vdbl && k->type == LVAL_NUM) {
+    lval* r = vec_result(a, 0);
+    if (!vec_scale_int(r->ints, v->ints, k->num, v->vlen)) { lval_del(r); r = NULL; }
+    LASSERT_RANGE("vec-scale", a, r);
+    lval_del(a);
+    return r;
+  }
+
+  lval* r = vec_result(a, 1);
+  double* d = vec_dbls(v);
+  vec_scale_dbl(r->dbls, d, lval_to_dbl(k), v->vlen);
+  if (!v->vdbl) { free(d); }
+  lval_del(a);
+  return r;
+}
+
+//Sums of ints that overflow are worked out again exactly
+lval* builtin_vec_dot(lenv* e, lval* a) {
+  LASSERT_VECS("vec-dot", a);
+
+  lval* x = a->cell[0];
+  lval* y = a->cell[1];
+  lval* r;
+  if (!x->vdbl && !y->vdbl) {
+    int64_t s;
+    if (vec_dot_int(x->ints, y->ints, x->vlen, &s)) {
+      r = lval_num(s);
+    } else {
+      r = vec_big_sum(x->ints, y->ints, x->vlen);
+    }
   } else {
-    //Get error message as string and return as lval_err
-    char* err_msg = mpc_err_string(r.error);
-    mpc_err_delete(r.error);
+    double* dx = vec_dbls(x);
+    double* dy = vec_dbls(y);
+    r = lval_dbl(vec_dot_dbl(dx, dy, x->vlen));
+    if (!x->vdbl) { free(dx); }
+    if (!y->vdbl) { free(dy); }
+  }
+  lval_del(a);
+  return r;
+}
 
-    lval* err = lval_err("Could not load Library %s", err_msg);
-    free(err_msg);
-    lval_del(a);
+lval* builtin_vec_sum(lenv* e, lval* a) {
+  LASSERT_NUM("vec-sum", a, 1);
+  LASSERT_VEC("vec-sum", a, 0);
+
+  lval* v = a->cell[0];
+  lval* r;
+  if (v->vdbl) {
+    r = lval_dbl(vec_sum_dbl(v->dbls, v->vlen));
+  } else {
+    int64_t s;
+    r = vec_sum_int(v->ints, v->vlen, &s) ? lval_num(s) : vec_big_sum(v->ints, NULL, v->vlen);
+  }
+  lval_del(a);
+  return r;
+}
+
+lval* builtin_vec_min(lenv* e, lval* a) {
+  LASSERT_NUM("vec-min", a, 1);
+  LASSERT_VEC("vec-min", a, 0);
+  LASSERT(a, a->cell[0]->vlen != 0, "Function vec-min passed an empty vector.");
+
+  lval* v = a->cell[0];
+  lval* r = v->vdbl ? lval_dbl(vec_min_dbl(v->dbls, v->vlen)) : lval_num(vec_min_int(v->ints, v->vlen));
+  lval_del(a);
+  return r;
+}
+
+lval* builtin_vec_max(lenv* e, lval* a) {
+  LASSERT_NUM("vec-max", a, 1);
+  LASSERT_VEC("vec-max", a, 0);
+  LASSERT(a, a->cell[0]->vlen != 0, "Function vec-max passed an empty vector.");
 
-    //Cleanup and return error
+  lval* v = a->cell[0];
+  lval* r = v->vdbl ? lval_dbl(vec_max_dbl(v->dbls, v->vlen)) : lval_num(vec_max_int(v->ints, v->vlen));
+  lval_del(a);
+  return r;
+}
+
+//Evaluate the expressions in a file in order, printing any errors. At the
+//top level nothing else is being evaluated, so the collector may run after
+//each expression while the rest are held.
+lval* lval_load(lenv* e, char* filename, int top) {
+  lval* expr = lval_read_file(filename);
+  if (expr->type == LVAL_ERR) {
+    lval* err = lval_err("Could not load Library %s", expr->err);
+    lval_del(expr);
     return err;
   }
+
+  if (top) { gc_hold(expr); }
+  while (expr->count) {
+    lval* x = lval_eval(e, lval_pop(expr, 0));
+    if (x->type == LVAL_ERR) {
+      lval_println(x);
+    }
+    lval_del(x);
+    if (top) { gc_safepoint(); }
+  }
+  if (top) { gc_drop(expr); }
+
+  lval_del(expr);
+
+  //Return empty list
+  return lval_sexpr();
+}
+
+lval* builtin_load(lenv* e, lval* a) {
+  LASSERT_NUM("load", a, 1);
+  LASSERT_TYPE("load", a, 0, LVAL_STR);
+
+  //Loaded from inside an evaluation, so never collect
+  lval* x = lval_load(e, a->cell[0]->str, 0);
+  lval_del(a);
+  return x;
 }
 
 lval* builtin_print(lenv* e, lval* a) {
@@ -353,3 +1252,32 @@ lval* builtin_error(lenv* e, lval* a) {
   return err;
 }
 
+
+//Report allocator counters as {allocated freed live slabs}, arguments are ignored
+lval* builtin_alloc_stats(lenv* e, lval* a) {
+  long allocs, frees, nslabs;
+  lalloc_stats(&allocs, &frees, &nslabs);
+  lval_del(a);
+
+  lval* x = lval_qexpr();
+  x = lval_add(x, lval_num(allocs));
+  x = lval_add(x, lval_num(frees));
+  x = lval_add(x, lval_num(allocs - frees));
+  x = lval_add(x, lval_num(nslabs));
+  return x;
+}
+
+//Report collector counters as {collections freed live pause-us max-pause-us}
+lval* builtin_gc_stats(lenv* e, lval* a) {
+  long collections, freed, live, total_us, max_us;
+  gc_stats(&collections, &freed, &live, &total_us, &max_us);
+  lval_del(a);
+
+  lval* x = lval_qexpr();
+  x = lval_add(x, lval_num(collections));
+  x = lval_add(x, lval_num(freed));
+  x = lval_add(x, lval_num(live));
+  x = lval_add(x, lval_num(total_us));
+  x = lval_add(x, lval_num(max_us));
+  return x;
+}
@@ -25,6 +25,32 @@
   LASSERT(args, args->cell[index]->count != 0, \
       "Function %s passed {} for argument %i.", func, index)
 
+#define LASSERT_NUMS(func, args) \
+  LASSERT(args, args->count > 0, \
+      "Function %s passed no arguments.", func) \
+  for (int i_ = 0; i_ < args->count; i_++) { \
+    LASSERT(args, args->cell[i_]->type == LVAL_NUM || args->cell[i_]->type == LVAL_DBL \
+        || args->cell[i_]->type == LVAL_BIG, \
+        "Function %s cannot operate on non-number, argument %i", func, i_) \
+  }
+
+#define LASSERT_ORD(func, args) \
+  LASSERT_NUM(func, args, 2) \
+  LASSERT_NUMS(func, args)
+
+#define LASSERT_LOGIC(func, args) \
+  LASSERT_NUM(func, args, 2) \
+  LASSERT_TYPE(func, args, 0, LVAL_NUM) \
+  LASSERT_TYPE(func, args, 1, LVAL_NUM)
+
+#define LASSERT_RANGE(func, args, cond) \
+  LASSERT(args, cond, "Function %s overflowed, result is out of range.", func)
+
+#define LASSERT_KEY(func, args, index) \
+  LASSERT(args, lval_hashable(args->cell[index]), \
+      "Function '%s' passed unhashable key for argument %i. Got %s, Expected Number, Symbol or String", \
+      func, index, ltype_name(args->cell[index]->type))
+
 //Utility functions
 char* ltype_name(ltype_t type);
 
@@ -33,10 +59,32 @@ lval* builtin_head(lenv* e, lval* a);
 lval* builtin_tail(lenv* e, lval* a);
 lval* builtin_list(lenv* e, lval* a);
 lval* builtin_eval(lenv* e, lval* a);
+lval* builtin_eval_expr(lval* a);
 lval* builtin_join(lenv* e, lval* a);
 lval* builtin_cons(lenv* e, lval* a);
 lval* builtin_len (lenv* e, lval* a);
 lval* builtin_init(lenv* e, lval* a);
+lval* builtin_map(lenv* e, lval* a);
+lval* builtin_filter(lenv* e, lval* a);
+lval* builtin_foldl(lenv* e, lval* a);
+lval* builtin_foldr(lenv* e, lval* a);
+lval* builtin_reverse(lenv* e, lval* a);
+lval* builtin_nth(lenv* e, lval* a);
+lval* builtin_sort(lenv* e, lval* a);
+
+//Parallel functions
+lval* builtin_pmap(lenv* e, lval* a);
+lval* builtin_preduce(lenv* e, lval* a);
+lval* builtin_spawn(lenv* e, lval* a);
+lval* builtin_await(lenv* e, lval* a);
+lval* builtin_await_all(lenv* e, lval* a);
+
+//Map functions
+lval* builtin_map_new(lenv* e, lval* a);
+lval* builtin_map_get(lenv* e, lval* a);
+lval* builtin_map_put(lenv* e, lval* a);
+lval* builtin_map_del(lenv* e, lval* a);
+lval* builtin_map_keys(lenv* e, lval* a);
 
 //Variable functions
 lval* builtin_var(lenv* e, lval* a, char* func);
@@ -50,19 +98,17 @@ lval* builtin_gt(lenv*e, lval* a);
 lval* builtin_lt(lenv*e, lval* a);
 lval* builtin_ge(lenv*e, lval* a);
 lval* builtin_le(lenv*e, lval* a);
-lval* builtin_ord(lenv* e, lval* a, char* op);
 
 lval* builtin_eq(lenv* e, lval* a);
 lval* builtin_ne(lenv* e, lval* a);
-lval* builtin_cmp(lenv* e, lval* a, char* op);
 
 //Boolean logic
 lval* builtin_and(lenv* e, lval* a);
 lval* builtin_or(lenv* e, lval* a);
 lval* builtin_not(lenv* e, lval* a);
-lval* builtin_logic(lenv* e, lval* a, char* op);
 
 lval* builtin_if(lenv* e, lval* a);
+lval* builtin_if_branch(lval* a);
 
 //Math functions
 lval* builtin_add(lenv* e, lval* a);
@@ -72,11 +118,38 @@ lval* builtin_pow(lenv* e, lval* a);
 lval* builtin_div(lenv* e, lval* a);
 lval* builtin_mod(lenv* e, lval* a);
 
-lval* builtin_op(lenv* e, lval* a, char* op);
+//Float functions
+lval* builtin_sqrt(lenv* e, lval* a);
+lval* builtin_exp(lenv* e, lval* a);
+lval* builtin_log(lenv* e, lval* a);
+lval* builtin_sin(lenv* e, lval* a);
+lval* builtin_cos(lenv* e, lval* a);
+lval* builtin_floor(lenv* e, lval* a);
+lval* builtin_ceil(lenv* e, lval* a);
+lval* builtin_round(lenv* e, lval* a);
+
+//Vector functions
+lval* builtin_vec(lenv* e, lval* a);
+lval* builtin_vec_range(lenv* e, lval* a);
+lval* builtin_vec_list(lenv* e, lval* a);
+lval* builtin_vec_len(lenv* e, lval* a);
+lval* builtin_vec_get(lenv* e, lval* a);
+lval* builtin_vec_add(lenv* e, lval* a);
+lval* builtin_vec_mul(lenv* e, lval* a);
+lval* builtin_vec_scale(lenv* e, lval* a);
+lval* builtin_vec_dot(lenv* e, lval* a);
+lval* builtin_vec_sum(lenv* e, lval* a);
+lval* builtin_vec_min(lenv* e, lval* a);
+lval* builtin_vec_max(lenv* e, lval* a);
 
 //String functions
+lval* lval_load(lenv* e, char* filename, int top);
 lval* builtin_load(lenv* e, lval* a);
 lval* builtin_print(lenv* e, lval* a);
 lval* builtin_error(lenv* e, lval* a);
 
+//Memory functions
+lval* builtin_alloc_stats(lenv* e, lval* a);
+lval* builtin_gc_stats(lenv* e, lval* a);
+
 #endif
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lval.h"
+#include "reader.h"
+#include "big.h"
+#include "gc.h"
+#include "interp.h"
+#include "blisp.h"
+
+//Every call enters the interpreter it is given for its duration, so
+//values are made and freed in its heap whichever thread calls. Inside a
+//native function it has been entered already.
+
+//Evaluations running on this thread. Only outside them may the collector
+//run, with the values the caller holds kept as roots. Inside one, values
+//are on the evaluation's stack and are never held.
+static __thread int embed_depth = 0;
+
+static lval* embed_hold(lval* v) {
+  if (!embed_depth) { gc_hold(v); }
+  return v;
+}
+
+static void embed_drop(lval* v) {
+  if (!embed_depth) { gc_drop(v); }
+}
+
+blisp_interp* blisp_new(int flags) {
+  int f = 0;
+  if (flags & BLISP_VM) { f |= LINTERP_VM; }
+  if (flags & BLISP_MPC) { f |= LINTERP_MPC; }
+  if (flags & BLISP_GC) { f |= LINTERP_GC; }
+  return linterp_new(f);
+}
+
+void blisp_del(blisp_interp* b) {
+  linterp_del(b);
+}
+
+blisp_interp* blisp_current(void) {
+  return linterp_current();
+}
+
+//Evaluate the expressions read into exprs in order, consuming it. From
+//the caller, collect after each while the rest and the result are held.
+static lval* embed_eval(lenv* e, lval* exprs) {
+  if (exprs->type == LVAL_ERR) { return embed_hold(exprs); }
+
+  int top = !embed_depth;
+  embed_hold(exprs);
+  lval* x = lval_sexpr();
+  while (exprs->count && x->type != LVAL_ERR) {
+    lval_del(x);
+    embed_depth++;
+    x = lval_eval(e, lval_pop(exprs, 0));
+    embed_depth--;
+
+    if (top) {
+      gc_hold(x);
+      gc_safepoint();
+      gc_drop(x);
+    }
+  }
+  embed_drop(exprs);
+  lval_del(exprs);
+  return embed_hold(x);
+}
+
+blisp_value* blisp_eval_string(blisp_interp* b, const char* src) {
+  linterp* prev = linterp_enter(b);
+  lval* x = embed_eval(b->env, lval_read_src("<string>", (char*)src, strlen(src)));
+  linterp_enter(prev);
+  return x;
+}
+
+blisp_value* blisp_eval_file(blisp_interp* b, const char* filename) {
+  linterp* prev = linterp_enter(b);
+  lval* x = embed_eval(b->env, lval_read_file((char*)filename));
+  linterp_enter(prev);
+  return x;
+}
+
+void blisp_register(blisp_interp* b, const char* name, blisp_native func) {
+  linterp* prev = linterp_enter(b);
+  lenv_add_builtin(b->env, (char*)name, func);
+  linterp_enter(prev);
+}
+
+void blisp_define(blisp_interp* b, const char* name, blisp_value* v) {
+  linterp* prev = linterp_enter(b);
+  lval* k = lval_sym((char*)name);
+  lenv_put(b->env, k, v);
+  embed_drop(v);
+  lval_del(k); lval_del(v);
+  linterp_enter(prev);
+}
+
+void blisp_collect(blisp_interp* b) {
+  linterp* prev = linterp_enter(b);
+  if (gc_enabled && !embed_depth) { gc_collect(); }
+  linterp_enter(prev);
+}
+
+blisp_value* blisp_int(blisp_interp* b, long x) {
+  linterp* prev = linterp_enter(b);
+  lval* v = embed_hold(lval_num(x));
+  linterp_enter(prev);
+  return v;
+}
+
+blisp_value* blisp_float(blisp_interp* b, double x) {
+  linterp* prev = linterp_enter(b);
+  lval* v = embed_hold(lval_dbl(x));
+  linterp_enter(prev);
+  return v;
+}
+
+blisp_value* blisp_string(blisp_interp* b, const char* s) {
+  linterp* prev = linterp_enter(b);
+  lval* v = embed_hold(lval_str((char*)s));
+  linterp_enter(prev);
+  return v;
+}
+
+blisp_value* blisp_symbol(blisp_interp* b, const char* s) {
+  linterp* prev = linterp_enter(b);
+  lval* v = embed_hold(lval_sym((char*)s));
+  linterp_enter(prev);
+  return v;
+}
+
+blisp_value* blisp_error(blisp_interp* b, const char* msg) {
+  linterp* prev = linterp_enter(b);
+  lval* v = embed_hold(lval_err("%s", msg));
+  linterp_enter(prev);
+  return v;
+}
+
+blisp_value* blisp_list(blisp_interp* b) {
+  linterp* prev = linterp_enter(b);
+  lval* v = embed_hold(lval_qexpr());
+  linterp_enter(prev);
+  return v;
+}
+
+blisp_value* blisp_append(blisp_interp* b, blisp_value* list, blisp_value* v) {
+  linterp* prev = linterp_enter(b);
+  embed_drop(list);
+  embed_drop(v);
+  list = embed_hold(lval_add(lval_unshare(list), v));
+  linterp_enter(prev);
+  return list;
+}
+
+void blisp_free(blisp_interp* b, blisp_value* v) {
+  linterp* prev = linterp_enter(b);
+  embed_drop(v);
+  lval_del(v);
+  linterp_enter(prev);
+}
+
+enum blisp_type blisp_type_of(blisp_value* v) {
+  switch (v->type) {
+    case LVAL_NUM: case LVAL_BIG: return BLISP_INT;
+    case LVAL_DBL: return BLISP_FLOAT;
+    case LVAL_STR: return BLISP_STRING;
+    case LVAL_SYM: return BLISP_SYMBOL;
+    case LVAL_FUN: return BLISP_FUNCTION;
+    case LVAL_MAP: return BLISP_MAP;
+    case LVAL_VEC: return BLISP_VECTOR;
+    case LVAL_ERR: return BLISP_ERROR;
+    case LVAL_FUT: return BLISP_FUTURE;
+    default: return BLISP_LIST;
+  }
+}
+
+int blisp_to_long(blisp_value* v, long* out) {
+  if (v->type == LVAL_NUM) { *out = v->num; return 1; }
+  if (v->type == LVAL_BIG) { return big_to_long(v->big, out); }
+  return 0;
+}
+
+int blisp_to_double(blisp_value* v, double* out) {
+  switch (v->type) {
+    case LVAL_NUM: *out = (double)v->num; return 1;
+    case LVAL_DBL: *out = v->dbl; return 1;
+    case LVAL_BIG: *out = big_to_dbl(v->big); return 1;
+    default: return 0;
+  }
+}
+
+const char* blisp_to_string(blisp_value* v) {
+  switch (v->type) {
+    case LVAL_STR: return v->str;
+    case LVAL_SYM: return v->sym;
+    case LVAL_ERR: return v->err;
+    default: return NULL;
+  }
+}
+
+int blisp_count(blisp_value* v) {
+  return v->type == LVAL_SEXPR || v->type == LVAL_QEXPR ? v->count : 0;
+}
+
+blisp_value* blisp_item(blisp_value* v, int i) {
+  return i >= 0 && i < blisp_count(v) ? v->cell[i] : NULL;
+}
@@ -0,0 +1,228 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <time.h>
+#include "lval.h"
+#include "vm.h"
+#include "alloc.h"
+#include "gc.h"
+
+__thread int gc_enabled = 0;
+
+//Collector of the interpreter this thread has entered
+static __thread struct gc_heap* gc = NULL;
+
+struct gc_heap* gc_use(struct gc_heap* g) {
+  struct gc_heap* prev = gc;
+  gc = g;
+  return prev;
+}
+
+#define GC_LINK(v) ((struct gc_link*)(v) - 1)
+#define GC_CELL(l) ((lval*)((struct gc_link*)(l) + 1))
+
+//Allocate a cell behind a link header and add it to the live cells
+void* gc_alloc(size_t size) {
+  struct gc_link* l = lalloc(sizeof(struct gc_link) + size);
+  l->prev = NULL;
+  l->next = gc->cells;
+  l->mark = 0;
+  if (gc->cells) { gc->cells->prev = l; }
+  gc->cells = l;
+
+  gc->live++;
+  gc->allocs++;
+  return l + 1;
+}
+
+//Unlink and release a cell, size must match the gc_alloc call
+void gc_free(void* p, size_t size) {
+  struct gc_link* l = GC_LINK(p);
+  if (l->prev) { l->prev->next = l->next; } else { gc->cells = l->next; }
+  if (l->next) { l->next->prev = l->prev; }
+
+  gc->live--;
+  lfree(l, sizeof(struct gc_link) + size);
+}
+
+//Add an environment whose values are always reachable
+void gc_root(lenv* e) {
+  if (gc->nroots < GC_MAX_ROOTS) { gc->roots[gc->nroots++] = e; }
+}
+
+//Keep a value reachable while C code holds it between safe points, such
+//as expressions not yet evaluated. Holds nest and are counted.
+void gc_hold(lval* v) {
+  if (!gc_enabled) { return; }
+  struct gc_hold* h;
+  HASH_FIND_PTR(gc->held, &v, h);
+  if (!h) {
+    h = malloc(sizeof(struct gc_hold));
+    h->v = v;
+    h->count = 0;
+    HASH_ADD_PTR(gc->held, v, h);
+  }
+  h->count++;
+}
+
+//Release one hold on v, before the value itself is deleted
+void gc_drop(lval* v) {
+  if (!gc_enabled) { return; }
+  struct gc_hold* h;
+  HASH_FIND_PTR(gc->held, &v, h);
+  if (h && --h->count == 0) {
+    HASH_DEL(gc->held, h);
+    free(h);
+  }
+}
+
+//Release every hold, when the interpreter is deleted
+void gc_release(void) {
+  struct gc_hold* h;
+  struct gc_hold* tmp;
+  HASH_ITER(hh, gc->held, h, tmp) {
+    HASH_DEL(gc->held, h);
+    free(h);
+  }
+}
+
+// Cells found but not yet scanned
+struct gc_stack {
+  int count;
+  int size;
+  lval** cells;
+};
+
+static void gc_push(struct gc_stack* s, lval* v) {
+  if (GC_LINK(v)->mark) { return; }
+  GC_LINK(v)->mark = 1;
+
+  if (s->count == s->size) {
+    s->size = s->size ? s->size * 2 : 256;
+    s->cells = realloc(s->cells, sizeof(lval*) * s->size);
+  }
+  s->cells[s->count++] = v;
+}
+
+//Push the values held by an environment. The parent is not owned by e
+//and is reached through its own owner if it is live.
+static void gc_push_env(struct gc_stack* s, lenv* e) {
+  if (e->slots) {
+    gc_push(s, e->slots);
+    for (int i = 0; i < e->slots->count; i++) {
+      if (e->vals[i]) { gc_push(s, e->vals[i]); }
+    }
+  }
+  for (struct lvar* var = e->vars; var; var = var->hh.next) {
+    gc_push(s, var->val);
+  }
+}
+
+//Mark everything reachable from the roots
+static void gc_mark(void) {
+  struct gc_stack s = { 0, 0, NULL };
+  for (int i = 0; i < gc->nroots; i++) {
+    gc_push_env(&s, gc->roots[i]);
+  }
+  for (struct gc_hold* h = gc->held; h; h = h->hh.next) {
+    gc_push(&s, h->v);
+  }
+
+  while (s.count) {
+    lval* v = s.cells[--s.count];
+    switch (v->type) {
+      case LVAL_FUN:
+        if (v->builtin) { break; }
+        gc_push(&s, v->formals);
+        gc_push(&s, v->body);
+        gc_push_env(&s, v->env);
+        if (v->code) {
+          for (int i = 0; i < v->code->nconsts; i++) { gc_push(&s, v->code->consts[i]); }
+        }
+      break;
+
+      //Items outside the view are still held by the buffer
+      case LVAL_SEXPR:
+      case LVAL_QEXPR:
+        if (!v->buf) { break; }
+        for (int i = v->buf->lo; i < v->buf->used; i++) {
+          if (v->buf->items[i]) { gc_push(&s, v->buf->items[i]); }
+        }
+      break;
+
+      case LVAL_MAP:
+        for (struct lentry* en = v->map; en; en = en->hh.next) {
+          gc_push(&s, en->key);
+          gc_push(&s, en->val);
+        }
+      break;
+
+      default: break;
+    }
+  }
+  free(s.cells);
+}
+
+//Free every unmarked cell. Garbage may reference other garbage, so each
+//is held while they are cleared and only then released together.
+static void gc_sweep(void) {
+  struct gc_link* garbage = NULL;
+  struct gc_link* next;
+  for (struct gc_link* l = gc->cells; l; l = next) {
+    next = l->next;
+    if (l->mark) { l->mark = 0; continue; }
+
+    if (l->prev) { l->prev->next = l->next; } else { gc->cells = l->next; }
+    if (l->next) { l->next->prev = l->prev; }
+    l->next = garbage;
+    garbage = l;
+    GC_CELL(l)->refs++;
+  }
+
+  for (struct gc_link* l = garbage; l; l = l->next) {
+    lval_clear(GC_CELL(l));
+  }
+
+  for (struct gc_link* l = garbage; l; l = next) {
+    next = l->next;
+    gc->live--;
+    gc->freed++;
+    lfree(l, sizeof(struct gc_link) + lval_size(GC_CELL(l)->type));
+  }
+}
+
+//Collect now. Only safe where every live value is reachable from a root,
+//between files and prompt lines when nothing is being evaluated.
+void gc_collect(void) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  gc_mark();
+  gc_sweep();
+  gc->allocs = 0;
+  gc->survived = gc->live;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  gc->collections++;
+  gc->total_us += us;
+  if (us > gc->max_us) { gc->max_us = us; }
+}
+
+//Collect if enough has been allocated since the last collection
+void gc_safepoint(void) {
+  if (!gc_enabled) { return; }
+  if (gc->allocs >= GC_MIN_ALLOCS && gc->allocs >= gc->survived) { gc_collect(); }
+}
+
+void gc_stats(long* collections, long* freed, long* live, long* total_us, long* max_us) {
+  //Pool workers have no collector
+  if (!gc) {
+    *collections = *freed = *live = *total_us = *max_us = 0;
+    return;
+  }
+  *collections = gc->collections;
+  *freed = gc->freed;
+  *live = gc->live;
+  *total_us = gc->total_us;
+  *max_us = gc->max_us;
+}
@@ -0,0 +1,64 @@
+#include <stddef.h>
+#include "lval.h"
+
+#ifndef GC_H
+#define GC_H
+
+// Collect once this many cells have been allocated since the last
+// collection, or as many as survived it if that is more
+#define GC_MIN_ALLOCS 100000
+#define GC_MAX_ROOTS 8
+
+// Header in front of every lval while the collector is enabled, linking
+// all live cells so they can be swept
+struct gc_link {
+  struct gc_link* prev;
+  struct gc_link* next;
+  int mark;
+};
+
+// Value held from C outside any environment, see gc_hold
+struct gc_hold {
+  lval* v;
+  int count;
+  UT_hash_handle hh;
+};
+
+// Collector state and pause statistics
+struct gc_heap {
+  struct gc_link* cells;
+  long live;
+  long allocs;   // Since the last collection
+  long survived; // Live after the last collection
+
+  lenv* roots[GC_MAX_ROOTS];
+  int nroots;
+  struct gc_hold* held;
+
+  long collections;
+  long freed;
+  long total_us;
+  long max_us;
+};
+
+// Set to trace the heap from the roots at safe points, reclaiming cells
+// reference counting missed. Set for the interpreter a thread has entered,
+// pool workers allocate directly.
+extern __thread int gc_enabled;
+
+//Collect into g on this thread, returning the collector used before
+struct gc_heap* gc_use(struct gc_heap* g);
+
+void* gc_alloc(size_t size);
+void gc_free(void* p, size_t size);
+
+void gc_root(lenv* e);
+void gc_hold(lval* v);
+void gc_drop(lval* v);
+void gc_release(void);
+void gc_collect(void);
+void gc_safepoint(void);
+
+void gc_stats(long* collections, long* freed, long* live, long* total_us, long* max_us);
+
+#endif
@@ -0,0 +1,648 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lval.h"
+#include "alloc.h"
+#include "image.h"
+#include "big.h"
+#include "uthash.h"
+
+// An image is a header, the names of every symbol it uses and one
+// environment record, followed by a value if it was packed. Values refer
+// to symbols by index into the names and to values already in the image
+// by the order they were written in, so nothing in the file depends on
+// where it is loaded.
+struct image_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t order;   // IMAGE_ORDER as written, catches a foreign byte order
+  uint32_t nsyms;
+  uint32_t nvals;
+  uint64_t size;    // Bytes following the header
+};
+
+#define IMAGE_ORDER 0x01020304
+
+// Record tags, each value starts with one byte giving its kind
+enum {
+  IMG_NONE,     //             Empty slot
+  IMG_NUM,      // int64
+  IMG_ERR,      // len bytes
+  IMG_SYM,      // sym
+  IMG_STR,      // len bytes
+  IMG_BUILTIN,  // sym         Builtin registered under the name sym
+  IMG_LAMBDA,   // formals body env
+  IMG_SEXPR,    // count cells
+  IMG_QEXPR,    // count cells
+  IMG_REF,      // id          Value already read, shared
+  IMG_MAP,      // count (key value)*
+  IMG_DBL,      // double
+  IMG_BIG,      // neg count limbs
+  IMG_VEC       // dbl count64 numbers
+};
+
+// Growable output buffer
+struct image_buf {
+  char* data;
+  size_t len;
+  size_t size;
+};
+
+// Symbol and value numbering while writing, keyed by pointer
+struct image_sym {
+  char* name;
+  uint32_t index;
+  UT_hash_handle hh;
+};
+
+struct image_ref {
+  lval* v;
+  uint32_t id;
+  UT_hash_handle hh;
+};
+
+struct image_writer {
+  struct image_buf syms;
+  struct image_buf data;
+
+  struct image_sym* sym_ids;
+  uint32_t nsyms;
+  struct image_ref* refs;
+  uint32_t nvals;
+
+  lval* err;
+};
+
+struct image_reader {
+  char* filename;
+  char* p;
+  char* end;
+
+  char** syms;
+  uint32_t nsyms;
+
+  //Every value read so far holds a reference here for IMG_REF
+  lval** vals;
+  uint32_t nvals;
+  uint32_t count;
+
+  lval* err;
+};
+
+// Builtin as lenv_add_builtins registers it, builtins are written by name
+struct image_builtin {
+  char* sym;
+  lbuiltin func;
+  UT_hash_handle hh;      // By name
+  UT_hash_handle by_func;
+};
+
+//The table is built once and only read after, it holds no values so it
+//belongs to no interpreter's heap
+static struct image_builtin* builtins = NULL;
+static struct image_builtin* builtin_funcs = NULL;
+static pthread_once_t builtins_once = PTHREAD_ONCE_INIT;
+
+static void image_builtins(void) {
+  lenv* e = lenv_new();
+  lenv_add_builtins(e);
+  for (struct lvar* var = e->vars; var; var = var->hh.next) {
+    struct image_builtin* b = malloc(sizeof(struct image_builtin));
+    b->sym = var->sym;
+    b->func = var->val->builtin;
+    HASH_ADD_PTR(builtins, sym, b);
+    HASH_ADD(by_func, builtin_funcs, func, sizeof(lbuiltin), b);
+  }
+  lenv_del(e);
+}
+
+static void put_bytes(struct image_buf* b, void* p, size_t len) {
+  if (b->len + len > b->size) {
+    while (b->len + len > b->size) { b->size = b->size ? b->size * 2 : 4096; }
+    b->data = realloc(b->data, b->size);
+  }
+  memcpy(b->data + b->len, p, len);
+  b->len += len;
+}
+
+static void put_tag(struct image_buf* b, uint8_t tag) { put_bytes(b, &tag, 1); }
+static void put_u32(struct image_buf* b, uint32_t x) { put_bytes(b, &x, sizeof(x)); }
+
+static void put_str(struct image_buf* b, char* s) {
+  uint32_t len = strlen(s);
+  put_u32(b, len);
+  put_bytes(b, s, len);
+}
+
+//Write the index of an interned name, adding it to the names on first use
+static void put_sym(struct image_writer* w, char* name) {
+  struct image_sym* s;
+  HASH_FIND_PTR(w->sym_ids, &name, s);
+  if (!s) {
+    s = malloc(sizeof(struct image_sym));
+    s->name = name;
+    s->index = w->nsyms++;
+    HASH_ADD_PTR(w->sym_ids, name, s);
+    put_str(&w->syms, name);
+  }
+  put_u32(&w->data, s->index);
+}
+
+static void write_env(struct image_writer* w, lenv* e);
+
+static void write_value(struct image_writer* w, lval* v) {
+  struct image_ref* r;
+  HASH_FIND_PTR(w->refs, &v, r);
+  if (r) {
+    put_tag(&w->data, IMG_REF);
+    put_u32(&w->data, r->id);
+    return;
+  }
+
+  switch (v->type) {
+    case LVAL_NUM: {
+      int64_t x = v->num;
+      put_tag(&w->data, IMG_NUM);
+      put_bytes(&w->data, &x, sizeof(x));
+    } break;
+    case LVAL_DBL:
+      put_tag(&w->data, IMG_DBL);
+      put_bytes(&w->data, &v->dbl, sizeof(double));
+    break;
+    case LVAL_BIG: {
+      uint8_t neg = v->big->neg;
+      put_tag(&w->data, IMG_BIG);
+      put_bytes(&w->data, &neg, 1);
+      put_u32(&w->data, v->big->n);
+      put_bytes(&w->data, v->big->d, sizeof(uint32_t) * v->big->n);
+    } break;
+    case LVAL_VEC: {
+      uint8_t dbl = v->vdbl;
+      uint64_t n = v->vlen;
+      put_tag(&w->data, IMG_VEC);
+      put_bytes(&w->data, &dbl, 1);
+      put_bytes(&w->data, &n, sizeof(n));
+      put_bytes(&w->data, v->ints, sizeof(int64_t) * n);
+    } break;
+    case LVAL_ERR: put_tag(&w->data, IMG_ERR); put_str(&w->data, v->err); break;
+    case LVAL_STR: put_tag(&w->data, IMG_STR); put_str(&w->data, v->str); break;
+    case LVAL_SYM: put_tag(&w->data, IMG_SYM); put_sym(w, v->sym); break;
+
+    case LVAL_FUN:
+      if (v->builtin) {
+        //Find the name the builtin is registered under
+        struct image_builtin* b;
+        pthread_once(&builtins_once, image_builtins);
+        HASH_FIND(by_func, builtin_funcs, &v->builtin, sizeof(lbuiltin), b);
+        if (!b) {
+          if (!w->err) { w->err = lval_err("Function is not a registered builtin"); }
+          return;
+        }
+        put_tag(&w->data, IMG_BUILTIN);
+        put_sym(w, b->sym);
+      } else {
+        put_tag(&w->data, IMG_LAMBDA);
+        write_value(w, v->formals);
+        write_value(w, v->body);
+        write_env(w, v->env);
+      }
+    break;
+
+    //A future's result only exists in the process that spawned it
+    case LVAL_FUT:
+      if (!w->err) { w->err = lval_err("Futures cannot be written to an image"); }
+      return;
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      put_tag(&w->data, v->type == LVAL_SEXPR ? IMG_SEXPR : IMG_QEXPR);
+      put_u32(&w->data, v->count);
+      for (int i = 0; i < v->count; i++) {
+        write_value(w, v->cell[i]);
+      }
+    break;
+
+    case LVAL_MAP:
+      put_tag(&w->data, IMG_MAP);
+      put_u32(&w->data, HASH_COUNT(v->map));
+      for (struct lentry* en = v->map; en; en = en->hh.next) {
+        write_value(w, en->key);
+        write_value(w, en->val);
+      }
+    break;
+  }
+
+  //Values are numbered once complete, the reader numbers them in the
+  //same order as it finishes building them
+  r = malloc(sizeof(struct image_ref));
+  r->v = v;
+  r->id = w->nvals++;
+  HASH_ADD_PTR(w->refs, v, r);
+}
+
+//Write an environment's slots and variables. The parent is not written,
+//loaded lambdas are given one when they are called.
+static void write_env(struct image_writer* w, lenv* e) {
+  if (e->slots) {
+    write_value(w, e->slots);
+    for (int i = 0; i < e->slots->count; i++) {
+      if (e->vals[i]) { write_value(w, e->vals[i]); } else { put_tag(&w->data, IMG_NONE); }
+    }
+  } else {
+    put_tag(&w->data, IMG_NONE);
+  }
+
+  put_u32(&w->data, HASH_COUNT(e->vars));
+  for (struct lvar* var = e->vars; var; var = var->hh.next) {
+    put_sym(w, var->sym);
+    write_value(w, var->val);
+  }
+}
+
+//Release the numbering tables and fill in the header once everything
+//has been written
+static void write_finish(struct image_writer* w, struct image_header* h) {
+  struct image_sym *s, *stmp;
+  HASH_ITER(hh, w->sym_ids, s, stmp) { HASH_DEL(w->sym_ids, s); free(s); }
+  struct image_ref *r, *rtmp;
+  HASH_ITER(hh, w->refs, r, rtmp) { HASH_DEL(w->refs, r); free(r); }
+
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, IMAGE_MAGIC, sizeof(h->magic));
+  h->version = IMAGE_VERSION;
+  h->order = IMAGE_ORDER;
+  h->nsyms = w->nsyms;
+  h->nvals = w->nvals;
+  h->size = w->syms.len + w->data.len;
+}
+
+lval* image_dump(lenv* e, char* filename) {
+  struct image_writer w;
+  memset(&w, 0, sizeof(w));
+  write_env(&w, e);
+
+  struct image_header h;
+  write_finish(&w, &h);
+
+  lval* x = w.err;
+  if (!x) {
+    FILE* f = fopen(filename, "wb");
+    int ok = f
+      && fwrite(&h, sizeof(h), 1, f) == 1
+      && fwrite(w.syms.data, 1, w.syms.len, f) == w.syms.len
+      && fwrite(w.data.data, 1, w.data.len, f) == w.data.len;
+    if (f && fclose(f) != 0) { ok = 0; }
+    x = ok ? lval_sexpr() : lval_err("%s: error: Unable to write image!", filename);
+  }
+
+  free(w.syms.data);
+  free(w.data.data);
+  return x;
+}
+
+char* image_pack(lenv* e, lval* v, size_t* len, lval** err) {
+  struct image_writer w;
+  memset(&w, 0, sizeof(w));
+  if (e) {
+    write_env(&w, e);
+  } else {
+    put_tag(&w.data, IMG_NONE);
+    put_u32(&w.data, 0);
+  }
+  write_value(&w, v);
+
+  struct image_header h;
+  write_finish(&w, &h);
+
+  char* src = NULL;
+  if (w.err) {
+    *err = w.err;
+  } else {
+    *len = sizeof(h) + w.syms.len + w.data.len;
+    src = malloc(*len);
+    memcpy(src, &h, sizeof(h));
+    if (w.syms.len) { memcpy(src + sizeof(h), w.syms.data, w.syms.len); }
+    memcpy(src + sizeof(h) + w.syms.len, w.data.data, w.data.len);
+  }
+
+  free(w.syms.data);
+  free(w.data.data);
+  return src;
+}
+
+//Record that the image is malformed, NULL is returned to unwind
+static void* corrupt(struct image_reader* r) {
+  if (!r->err) { r->err = lval_err("%s: error: Image is corrupt!", r->filename); }
+  return NULL;
+}
+
+static int get_bytes(struct image_reader* r, void* p, size_t len) {
+  if ((size_t)(r->end - r->p) < len) { corrupt(r); return 0; }
+  memcpy(p, r->p, len);
+  r->p += len;
+  return 1;
+}
+
+static int get_u32(struct image_reader* r, uint32_t* x) {
+  return get_bytes(r, x, sizeof(*x));
+}
+
+static char* get_sym(struct image_reader* r) {
+  uint32_t i;
+  if (!get_u32(r, &i)) { return NULL; }
+  if (i >= r->nsyms) { return corrupt(r); }
+  return r->syms[i];
+}
+
+//Copy out a length prefixed string, terminating it
+static char* get_str(struct image_reader* r) {
+  uint32_t len;
+  if (!get_u32(r, &len)) { return NULL; }
+  if ((size_t)(r->end - r->p) < len) { return corrupt(r); }
+
+  char* s = malloc(len+1);
+  memcpy(s, r->p, len);
+  s[len] = '\0';
+  r->p += len;
+  return s;
+}
+
+static lval* read_value(struct image_reader* r, int allow_none);
+static int read_env(struct image_reader* r, lenv* e);
+
+static lval* read_list(struct image_reader* r, lval* x) {
+  uint32_t count;
+  if (!get_u32(r, &count)) { lval_del(x); return NULL; }
+
+  //The length is known up front so the cells are allocated once
+  if ((size_t)(r->end - r->p) < count) { lval_del(x); return corrupt(r); }
+  x = lval_resize(x, count);
+  for (uint32_t i = 0; i < count; i++) {
+    lval* y = read_value(r, 0);
+    if (!y) { lval_del(lval_resize(x, i)); return NULL; }
+    x->cell[i] = y;
+  }
+  return x;
+}
+
+static lval* read_map(struct image_reader* r) {
+  uint32_t count;
+  if (!get_u32(r, &count)) { return NULL; }
+
+  lval* m = lval_map();
+  for (uint32_t i = 0; i < count; i++) {
+    lval* k = read_value(r, 0);
+    if (!k) { lval_del(m); return NULL; }
+    lval* v = read_value(r, 0);
+    if (!v) { lval_del(k); lval_del(m); return NULL; }
+
+    //Keys written from a map are unique and hashable
+    if (!lval_hashable(k) || lval_map_get(m, k)) {
+      lval_del(k); lval_del(v); lval_del(m);
+      return corrupt(r);
+    }
+    m = lval_map_put(m, k, v);
+  }
+  return m;
+}
+
+//Check v is a q-expression made up of symbols, as formals and slots are
+static int is_symbols(lval* v) {
+  if (v->type != LVAL_QEXPR) { return 0; }
+  for (int i = 0; i < v->count; i++) {
+    if (v->cell[i]->type != LVAL_SYM) { return 0; }
+  }
+  return 1;
+}
+
+static lval* read_lambda(struct image_reader* r) {
+  lval* formals = read_value(r, 0);
+  if (!formals) { return NULL; }
+  lval* body = read_value(r, 0);
+  if (!body) { lval_del(formals); return NULL; }
+
+  lval* v = lval_new(LVAL_FUN);
+  v->builtin = NULL;
+  v->env = lenv_new();
+  v->formals = formals;
+  v->body = body;
+  v->code = NULL;
+
+  if (!read_env(r, v->env)) { lval_del(v); return NULL; }
+  if (!is_symbols(formals) || body->type != LVAL_QEXPR) { lval_del(v); return corrupt(r); }
+  return v;
+}
+
+static lval* read_value(struct image_reader* r, int allow_none) {
+  uint8_t tag;
+  if (!get_bytes(r, &tag, 1)) { return NULL; }
+
+  lval* x = NULL;
+  switch (tag) {
+    case IMG_NONE:
+      return allow_none ? NULL : corrupt(r);
+
+    case IMG_REF: {
+      uint32_t id;
+      if (!get_u32(r, &id)) { return NULL; }
+      if (id >= r->count) { return corrupt(r); }
+      return lval_copy(r->vals[id]);
+    }
+
+    case IMG_NUM: {
+      int64_t n;
+      if (!get_bytes(r, &n, sizeof(n))) { return NULL; }
+      if (n < LONG_MIN || n > LONG_MAX) { return corrupt(r); }
+      x = lval_num(n);
+    } break;
+
+    case IMG_DBL: {
+      double d;
+      if (!get_bytes(r, &d, sizeof(d))) { return NULL; }
+      x = lval_dbl(d);
+    } break;
+
+    case IMG_BIG: {
+      uint8_t neg;
+      uint32_t n;
+      if (!get_bytes(r, &neg, 1) || !get_u32(r, &n)) { return NULL; }
+      if ((size_t)(r->end - r->p) / sizeof(uint32_t) < n) { return corrupt(r); }
+
+      struct lbig* b = big_new(n);
+      memcpy(b->d, r->p, sizeof(uint32_t) * n);
+      r->p += sizeof(uint32_t) * n;
+      b->n = n;
+      b->neg = neg;
+      if (n == 0 || b->d[n-1] == 0) { big_del(b); return corrupt(r); }
+      x = lval_big(b);
+    } break;
+
+    case IMG_VEC: {
+      uint8_t dbl;
+      uint64_t n;
+      if (!get_bytes(r, &dbl, 1) || !get_bytes(r, &n, sizeof(n))) { return NULL; }
+      if (dbl > 1 || (size_t)(r->end - r->p) / sizeof(int64_t) < n) { return corrupt(r); }
+
+      x = lval_vec(n, dbl);
+      memcpy(x->ints, r->p, sizeof(int64_t) * n);
+      r->p += sizeof(int64_t) * n;
+    } break;
+
+    case IMG_ERR:
+    case IMG_STR: {
+      char* s = get_str(r);
+      if (!s) { return NULL; }
+      x = tag == IMG_ERR ? lval_err("%s", s) : lval_str(s);
+      free(s);
+    } break;
+
+    case IMG_SYM: {
+      char* s = get_sym(r);
+      if (!s) { return NULL; }
+
+      //Already interned, fill in the symbol directly
+      x = lval_new(LVAL_SYM);
+      x->sym = s;
+    } break;
+
+    case IMG_BUILTIN: {
+      char* s = get_sym(r);
+      if (!s) { return NULL; }
+
+      struct image_builtin* b;
+      pthread_once(&builtins_once, image_builtins);
+      HASH_FIND_PTR(builtins, &s, b);
+      if (!b) {
+        if (!r->err) { r->err = lval_err("%s: error: Image uses unknown builtin %s!", r->filename, s); }
+        return NULL;
+      }
+      x = lval_fun(b->func);
+    } break;
+
+    case IMG_LAMBDA: x = read_lambda(r); break;
+    case IMG_SEXPR: x = read_list(r, lval_sexpr()); break;
+    case IMG_QEXPR: x = read_list(r, lval_qexpr()); break;
+    case IMG_MAP: x = read_map(r); break;
+
+    default: return corrupt(r);
+  }
+
+  if (!x) { return NULL; }
+  if (r->count == r->nvals) { lval_del(x); return corrupt(r); }
+  r->vals[r->count++] = lval_copy(x);
+  return x;
+}
+
+//Read an environment record into e, returning 0 if the image is bad
+static int read_env(struct image_reader* r, lenv* e) {
+  lval* slots = read_value(r, 1);
+  if (r->err) { return 0; }
+
+  if (slots) {
+    if (e->slots || !is_symbols(slots)) { lval_del(slots); corrupt(r); return 0; }
+    e->slots = slots;
+    if (slots->count) {
+      e->vals = lalloc(sizeof(lval*) * slots->count);
+      for (int i = 0; i < slots->count; i++) { e->vals[i] = NULL; }
+    }
+    for (int i = 0; i < slots->count; i++) {
+      e->vals[i] = read_value(r, 1);
+      if (r->err) { return 0; }
+    }
+  }
+
+  uint32_t nvars;
+  if (!get_u32(r, &nvars)) { return 0; }
+  for (uint32_t i = 0; i < nvars; i++) {
+    char* name = get_sym(r);
+    if (!name) { return 0; }
+    lval* v = read_value(r, 0);
+    if (!v) { return 0; }
+
+    lval* k = lval_sym(name);
+    lenv_put(e, k, v);
+    lval_del(k); lval_del(v);
+  }
+  return 1;
+}
+
+//Read an image held in memory, binding its variables in e. If v is given
+//the value following the environment is read into it.
+static lval* read_image(lenv* e, char* filename, char* src, size_t size, lval** v) {
+  struct image_header h;
+  memset(&h, 0, sizeof(h));
+  if (size >= sizeof(h)) { memcpy(&h, src, sizeof(h)); }
+  if (memcmp(h.magic, IMAGE_MAGIC, sizeof(h.magic)) != 0) {
+    return lval_err("%s: error: Not a blisp image!", filename);
+  }
+  if (h.version != IMAGE_VERSION || h.order != IMAGE_ORDER) {
+    return lval_err("%s: error: Image was written for a different version or machine!", filename);
+  }
+
+  struct image_reader r;
+  memset(&r, 0, sizeof(r));
+  r.filename = filename;
+  r.p = src + sizeof(h);
+  r.end = src + size;
+
+  //Every symbol and value takes at least a byte, which bounds the tables
+  if (h.size != (uint64_t)(r.end - r.p) || h.nsyms > h.size || h.nvals > h.size) {
+    corrupt(&r);
+  } else {
+    //Intern the names once, symbols in the image are indexes into them
+    r.syms = malloc(sizeof(char*) * h.nsyms);
+    for (r.nsyms = 0; r.nsyms < h.nsyms; r.nsyms++) {
+      uint32_t len;
+      if (!get_u32(&r, &len)) { break; }
+      if ((size_t)(r.end - r.p) < len) { corrupt(&r); break; }
+      r.syms[r.nsyms] = lsym_intern_len(r.p, len);
+      r.p += len;
+    }
+
+    r.nvals = h.nvals;
+    r.vals = malloc(sizeof(lval*) * h.nvals);
+    if (!r.err) { read_env(&r, e); }
+    if (!r.err && v) { *v = read_value(&r, 0); }
+    if (!r.err && r.p != r.end) { corrupt(&r); }
+    if (r.err && v && *v) { lval_del(*v); }
+  }
+
+  for (uint32_t i = 0; i < r.count; i++) { lval_del(r.vals[i]); }
+  free(r.vals);
+  free(r.syms);
+  return r.err ? r.err : lval_sexpr();
+}
+
+lval* image_load(lenv* e, char* filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return lval_err("%s: error: Unable to open file!", filename); }
+
+  struct stat st;
+  char* src = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    src = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (src == MAP_FAILED) { return lval_err("%s: error: Unable to map image!", filename); }
+
+  lval* x = read_image(e, filename, src, st.st_size, NULL);
+  munmap(src, st.st_size);
+  return x;
+}
+
+lval* image_unpack(lenv* e, char* src, size_t len) {
+  lenv* tmp = e ? NULL : lenv_new();
+  lval* v = NULL;
+  lval* x = read_image(e ? e : tmp, "<packed>", src, len, &v);
+  if (tmp) { lenv_del(tmp); }
+  if (x->type == LVAL_ERR) { return x; }
+  lval_del(x);
+  return v;
+}
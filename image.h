@@ -0,0 +1,25 @@
+#include "lval.h"
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+// Images start with the magic string followed by the format version
+#define IMAGE_MAGIC "BLISPIMG"
+#define IMAGE_VERSION 1
+
+//Write the variables bound in e to an image file, or load them back into
+//e. Both return an empty s-expression on success or an error.
+lval* image_dump(lenv* e, char* filename);
+lval* image_load(lenv* e, char* filename);
+
+//Pack a value and the variables bound in e, which may be NULL, into an
+//image in memory. This is how values are moved between threads, which
+//each have their own heap. Returns the malloc'd image, or NULL with err
+//set if something could not be written.
+char* image_pack(lenv* e, lval* v, size_t* len, lval** err);
+
+//Read a packed image into this thread's heap, binding its variables in
+//e if it is not NULL. Returns the value or an error.
+lval* image_unpack(lenv* e, char* src, size_t len);
+
+#endif
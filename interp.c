@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lval.h"
+#include "vm.h"
+#include "reader.h"
+#include "interp.h"
+
+//Interpreter this thread has entered
+static __thread linterp* current = NULL;
+
+linterp* linterp_enter(linterp* in) {
+  linterp* prev = current;
+  current = in;
+
+  lalloc_use(in ? &in->heap : NULL);
+  gc_use(in ? &in->gc : NULL);
+  int flags = in ? in->flags : 0;
+  vm_enabled = (flags & LINTERP_VM) != 0;
+  reader_use_mpc = (flags & LINTERP_MPC) != 0;
+  gc_enabled = (flags & LINTERP_GC) != 0;
+  return prev;
+}
+
+linterp* linterp_current(void) {
+  return current;
+}
+
+linterp* linterp_new(int flags) {
+  linterp* in = calloc(1, sizeof(linterp));
+  in->flags = flags;
+
+  //The environment is allocated from the new interpreter's own heap
+  linterp* prev = linterp_enter(in);
+  in->env = lenv_new();
+  lenv_add_builtins(in->env);
+  gc_root(in->env);
+  linterp_enter(prev);
+  return in;
+}
+
+//Delete the environment, then release the heap wholesale along with
+//anything reference counting could not free
+void linterp_del(linterp* in) {
+  linterp* prev = linterp_enter(in);
+  lenv_del(in->env);
+
+  //With nothing left rooted a collection frees the remaining cycles
+  in->gc.nroots = 0;
+  gc_release();
+  if (gc_enabled) { gc_collect(); }
+  linterp_enter(prev == in ? NULL : prev);
+  lheap_free(&in->heap);
+  free(in);
+}
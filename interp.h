@@ -0,0 +1,38 @@
+#include "lval.h"
+#include "alloc.h"
+#include "gc.h"
+
+#ifndef INTERP_H
+#define INTERP_H
+
+// Options an interpreter is created with
+#define LINTERP_VM  1   // Evaluate through the bytecode vm
+#define LINTERP_MPC 2   // Read source through the mpc grammar
+#define LINTERP_GC  4   // Trace the heap at safe points
+
+// An interpreter, with its own global environment and heap. Any number
+// can exist at once and each thread may run a different one, but one
+// interpreter must only be used by one thread at a time. Values belong to
+// the heap they were allocated from and must not be handed to another
+// interpreter, except packed as images. Interned symbols, the builtin
+// table and the mpc grammar are never changed once made and are shared.
+struct linterp {
+  int flags;
+  lenv* env;
+
+  struct lheap heap;
+  struct gc_heap gc;
+};
+
+typedef struct linterp linterp;
+
+//Create an interpreter with the builtins defined
+linterp* linterp_new(int flags);
+void linterp_del(linterp* in);
+
+//Run in an interpreter on this thread until the next call, NULL leaves
+//every interpreter. Returns the one entered before.
+linterp* linterp_enter(linterp* in);
+linterp* linterp_current(void);
+
+#endif
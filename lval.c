@@ -2,34 +2,110 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stddef.h>
+#include <pthread.h>
 #include "mpc.h"
 #include "lval.h"
 #include "builtin.h"
+#include "vm.h"
+#include "alloc.h"
+#include "gc.h"
+#include "big.h"
+#include "pool.h"
 #include "uthash.h"
 
+//Symbols are shared by every thread, the table is locked while it is used
+static struct lsym* symbols = NULL;
+static pthread_mutex_t symbols_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//Find the unique copy of a symbol name, adding it if it is new. Interned
+//names live as long as the program and can be compared by pointer.
+char* lsym_intern(char* name) {
+  return lsym_intern_len(name, strlen(name));
+}
+
+//Intern the first len characters of name, which need not be terminated
+char* lsym_intern_len(char* name, size_t len) {
+  pthread_mutex_lock(&symbols_lock);
+  struct lsym* s;
+  HASH_FIND(hh, symbols, name, len, s);
+  if (s == NULL) {
+    s = malloc(sizeof(struct lsym));
+    s->name = malloc(len+1);
+    memcpy(s->name, name, len);
+    s->name[len] = '\0';
+    HASH_ADD_KEYPTR(hh, symbols, s->name, len, s);
+  }
+  pthread_mutex_unlock(&symbols_lock);
+  return s->name;
+}
+
 //Creates a new environment
 lenv* lenv_new(void) {
-  lenv* e = malloc(sizeof(lenv));
+  lenv* e = lalloc(sizeof(lenv));
   e->par = NULL;
+  e->slots = NULL;
+  e->vals = NULL;
   e->vars = NULL;
   return e;
 }
 
+//Creates an environment for a lambda with a slot for each formal
+lenv* lenv_frame(lval* formals) {
+  lenv* e = lenv_new();
+  e->slots = lval_qexpr();
+  for (int i = 0; i < formals->count; i++) {
+    if (strcmp(formals->cell[i]->sym, "&") == 0) { continue; }
+    e->slots = lval_add(e->slots, lval_copy(formals->cell[i]));
+  }
+
+  if (e->slots->count) {
+    e->vals = lalloc(sizeof(lval*) * e->slots->count);
+    for (int i = 0; i < e->slots->count; i++) { e->vals[i] = NULL; }
+  }
+  return e;
+}
+
+//Find the slot for sym, or -1 if it is not a formal of e
+int lenv_slot(lenv* e, char* sym) {
+  if (!e->slots) { return -1; }
+  for (int i = 0; i < e->slots->count; i++) {
+    if (e->slots->cell[i]->sym == sym) { return i; }
+  }
+  return -1;
+}
+
 //Deletes the provided environment
 void lenv_del(lenv* e) {
   struct lvar *current_var, *tmp;
 
+  //Release slot values and names
+  if (e->slots) {
+    for (int i = 0; i < e->slots->count; i++) {
+      if (e->vals[i]) { lval_del(e->vals[i]); }
+    }
+    if (e->slots->count) { lfree(e->vals, sizeof(lval*) * e->slots->count); }
+    lval_del(e->slots);
+  }
+
   //Iterate over hash table and clean up each node
   HASH_ITER(hh, e->vars, current_var, tmp) {
     HASH_DEL(e->vars, current_var);
     lval_del(current_var->val);
-    free(current_var->sym);
-    free(current_var);
+    lfree(current_var, sizeof(struct lvar));
   }
-  free(e);
+  lfree(e, sizeof(lenv));
 }
 
 void lenv_iter(lenv* e) {
+  //Print bound slots
+  for (int i = 0; e->slots && i < e->slots->count; i++) {
+    if (!e->vals[i]) { continue; }
+    printf("%s ", e->slots->cell[i]->sym);
+    lval_print(e->vals[i]);
+    printf("\n");
+  }
+
   struct lvar *current_var, *tmp;
   //Iterate over hash table and print each node
   HASH_ITER(hh, e->vars, current_var, tmp) {
@@ -39,25 +115,37 @@ void lenv_iter(lenv* e) {
   }
 }
 
-//Search environment for value
+//Search environment for value. Lambda frames are checked by comparing
+//slot names, the hash table is only searched if anything else was put.
 lval* lenv_get(lenv* e, lval* k) {
-  struct lvar *result;
-  HASH_FIND_STR(e->vars, k->sym, result);
-  if (result != NULL) {
-    return lval_copy(result->val);
-  }
-  if (e->par) {
-    return lenv_get(e->par, k);
-  } else {
-    return lval_err("Unbound symbol: %s", k->sym);
+  for (; e; e = e->par) {
+    int i = lenv_slot(e, k->sym);
+    if (i >= 0 && e->vals[i]) { return lval_copy(e->vals[i]); }
+
+    if (e->vars) {
+      struct lvar *result;
+      HASH_FIND_PTR(e->vars, &k->sym, result);
+      if (result != NULL) {
+        return lval_copy(result->val);
+      }
+    }
   }
+  return lval_err("Unbound symbol: %s", k->sym);
 }
 
 void lenv_put(lenv* e, lval* k, lval* v) {
+  //Formals are stored in their slot
+  int i = lenv_slot(e, k->sym);
+  if (i >= 0) {
+    if (e->vals[i]) { lval_del(e->vals[i]); }
+    e->vals[i] = lval_copy(v);
+    return;
+  }
+
   struct lvar *variable;
 
   //Search table to see if variable exists
-  HASH_FIND_STR(e->vars, k->sym, variable);
+  HASH_FIND_PTR(e->vars, &k->sym, variable);
   //Replace present value if exists
   if (variable != NULL) {
     lval_del(variable->val);
@@ -66,11 +154,10 @@ void lenv_put(lenv* e, lval* k, lval* v) {
   }
 
   //If no existing entry, place new entry in table
-  variable = malloc(sizeof(struct lvar));
-  variable->sym = malloc(sizeof(k->sym)+1);
-  strcpy(variable->sym, k->sym);
+  variable = lalloc(sizeof(struct lvar));
+  variable->sym = k->sym;
   variable->val = lval_copy(v);
-  HASH_ADD_STR(e->vars, sym, variable);
+  HASH_ADD_PTR(e->vars, sym, variable);
 }
 
 //Iterates until env has no parent and then defines value globally
@@ -80,21 +167,30 @@ void lenv_def(lenv* e, lval* k, lval* v) {
 }
 
 lenv* lenv_copy(lenv* e) {
-  lenv* n = malloc(sizeof(lenv));
-  n->vars = NULL;
+  lenv* n = lenv_new();
   n->par = e->par;
 
+  // Copy slot values, the slot names are shared
+  if (e->slots) {
+    n->slots = lval_copy(e->slots);
+    if (n->slots->count) {
+      n->vals = lalloc(sizeof(lval*) * n->slots->count);
+      for (int i = 0; i < n->slots->count; i++) {
+        n->vals[i] = e->vals[i] ? lval_copy(e->vals[i]) : NULL;
+      }
+    }
+  }
+
   // Iterate over hashtable and copy each value to new env
   struct lvar *cur_var;
   struct lvar *new_var;
   for (cur_var = e->vars; cur_var != NULL; cur_var = cur_var->hh.next) {
     // Allocate space for new lvar
-    new_var = malloc(sizeof(struct lvar));
-    new_var->sym = malloc(sizeof(cur_var->sym)+1);
+    new_var = lalloc(sizeof(struct lvar));
     // Copy values over and add to new table
-    strcpy(new_var->sym, cur_var->sym);
+    new_var->sym = cur_var->sym;
     new_var->val = lval_copy(cur_var->val);
-    HASH_ADD_STR(n->vars, sym, new_var);
+    HASH_ADD_PTR(n->vars, sym, new_var);
   }
 
   return n;
@@ -113,6 +209,20 @@ void lenv_add_builtins(lenv* e) {
   lenv_add_builtin(e, "head", builtin_head); lenv_add_builtin(e, "tail", builtin_tail);
   lenv_add_builtin(e, "eval", builtin_eval); lenv_add_builtin(e, "join", builtin_join);
   lenv_add_builtin(e, "cons", builtin_cons); lenv_add_builtin(e, "init", builtin_init);
+  lenv_add_builtin(e, "map", builtin_map); lenv_add_builtin(e, "filter", builtin_filter);
+  lenv_add_builtin(e, "foldl", builtin_foldl); lenv_add_builtin(e, "foldr", builtin_foldr);
+  lenv_add_builtin(e, "reverse", builtin_reverse); lenv_add_builtin(e, "nth", builtin_nth);
+  lenv_add_builtin(e, "sort", builtin_sort);
+
+  //Parallel functions
+  lenv_add_builtin(e, "pmap", builtin_pmap); lenv_add_builtin(e, "preduce", builtin_preduce);
+  lenv_add_builtin(e, "spawn", builtin_spawn); lenv_add_builtin(e, "await", builtin_await);
+  lenv_add_builtin(e, "await-all", builtin_await_all);
+
+  //Map functions
+  lenv_add_builtin(e, "map-new", builtin_map_new); lenv_add_builtin(e, "map-get", builtin_map_get);
+  lenv_add_builtin(e, "map-put", builtin_map_put); lenv_add_builtin(e, "map-del", builtin_map_del);
+  lenv_add_builtin(e, "map-keys", builtin_map_keys);
 
   //Variable functions
   lenv_add_builtin(e, "=",  builtin_put);  lenv_add_builtin(e, "def", builtin_def);
@@ -133,24 +243,89 @@ void lenv_add_builtins(lenv* e) {
   lenv_add_builtin(e, "*", builtin_mul); lenv_add_builtin(e, "/", builtin_div);
   lenv_add_builtin(e, "^", builtin_pow); lenv_add_builtin(e, "%", builtin_mod);
 
+  //Float functions
+  lenv_add_builtin(e, "sqrt", builtin_sqrt); lenv_add_builtin(e, "exp", builtin_exp);
+  lenv_add_builtin(e, "log", builtin_log); lenv_add_builtin(e, "sin", builtin_sin);
+  lenv_add_builtin(e, "cos", builtin_cos);
+  lenv_add_builtin(e, "floor", builtin_floor); lenv_add_builtin(e, "ceil", builtin_ceil);
+  lenv_add_builtin(e, "round", builtin_round);
+
+  //Vector functions
+  lenv_add_builtin(e, "vec", builtin_vec); lenv_add_builtin(e, "vec-range", builtin_vec_range);
+  lenv_add_builtin(e, "vec-list", builtin_vec_list); lenv_add_builtin(e, "vec-len", builtin_vec_len);
+  lenv_add_builtin(e, "vec-get", builtin_vec_get);
+  lenv_add_builtin(e, "vec-add", builtin_vec_add); lenv_add_builtin(e, "vec-mul", builtin_vec_mul);
+  lenv_add_builtin(e, "vec-scale", builtin_vec_scale); lenv_add_builtin(e, "vec-dot", builtin_vec_dot);
+  lenv_add_builtin(e, "vec-sum", builtin_vec_sum);
+  lenv_add_builtin(e, "vec-min", builtin_vec_min); lenv_add_builtin(e, "vec-max", builtin_vec_max);
+
   //String functions
   lenv_add_builtin(e, "load", builtin_load);
   lenv_add_builtin(e, "error", builtin_error);
   lenv_add_builtin(e, "print", builtin_print);
+
+  //Memory functions
+  lenv_add_builtin(e, "alloc-stats", builtin_alloc_stats);
+  lenv_add_builtin(e, "gc-stats", builtin_gc_stats);
+}
+
+//Bytes needed by an lval of the given type
+size_t lval_size(ltype_t type) {
+  switch (type) {
+    case LVAL_NUM: return offsetof(lval, num) + sizeof(long);
+    case LVAL_DBL: return offsetof(lval, dbl) + sizeof(double);
+    case LVAL_BIG: return offsetof(lval, big) + sizeof(struct lbig*);
+    case LVAL_ERR:
+    case LVAL_SYM:
+    case LVAL_STR: return offsetof(lval, str) + sizeof(char*);
+    case LVAL_FUN: return offsetof(lval, code) + sizeof(lcode*);
+    case LVAL_SEXPR:
+    case LVAL_QEXPR: return offsetof(lval, buf) + sizeof(struct lcells*);
+    case LVAL_MAP: return offsetof(lval, map) + sizeof(struct lentry*);
+    case LVAL_VEC: return offsetof(lval, ints) + sizeof(int64_t*);
+    case LVAL_FUT: return offsetof(lval, fut) + sizeof(struct lfuture*);
+  }
+  return sizeof(lval);
+}
+
+//Allocate a cell for an lval of the given type holding one reference
+lval* lval_new(ltype_t type) {
+  size_t size = lval_size(type);
+  lval* v = gc_enabled ? gc_alloc(size) : lalloc(size);
+  v->type = type;
+  v->refs = 1;
+  return v;
 }
 
 // Create numeric lval and return pointer
 lval* lval_num(long x) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_NUM;
+  lval* v = lval_new(LVAL_NUM);
   v->num = x;
   return v;
 }
 
+lval* lval_dbl(double x) {
+  lval* v = lval_new(LVAL_DBL);
+  v->dbl = x;
+  return v;
+}
+
+//Wrap the result of bignum arithmetic, which becomes an ordinary number
+//again if it fits. Takes ownership of b.
+lval* lval_big(struct lbig* b) {
+  long x;
+  if (big_to_long(b, &x)) {
+    big_del(b);
+    return lval_num(x);
+  }
+  lval* v = lval_new(LVAL_BIG);
+  v->big = b;
+  return v;
+}
+
 // Create error lval and return pointer
 lval* lval_err(char* fmt, ...) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_ERR;
+  lval* v = lval_new(LVAL_ERR);
 
   va_list va;
   va_start(va, fmt);
@@ -168,66 +343,101 @@ lval* lval_err(char* fmt, ...) {
 
 // Create symbol lval and return pointer
 lval* lval_sym(char* s) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_SYM;
-  v->sym = malloc(strlen(s) + 1);
-  strcpy(v->sym, s);
+  return lval_sym_len(s, strlen(s));
+}
+
+// Create symbol lval from the first len characters of s
+lval* lval_sym_len(char* s, size_t len) {
+  lval* v = lval_new(LVAL_SYM);
+  v->sym = lsym_intern_len(s, len);
   return v;
 }
 
 lval* lval_str(char* s) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_STR;
+  lval* v = lval_new(LVAL_STR);
   v->str = malloc(strlen(s)+1);
   strcpy(v->str, s);
   return v;
 }
 
 lval* lval_fun(lbuiltin func) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_FUN;
+  lval* v = lval_new(LVAL_FUN);
   v->builtin = func;
   return v;
 }
 
 lval* lval_sexpr(void) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_SEXPR;
+  lval* v = lval_new(LVAL_SEXPR);
   v->count = 0;
   v->cell = NULL;
+  v->buf = NULL;
   return v;
 }
 
 lval* lval_qexpr(void) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_QEXPR;
+  lval* v = lval_new(LVAL_QEXPR);
   v->count = 0;
   v->cell = NULL;
+  v->buf = NULL;
   return v;
 }
 
 //Construct a lambda lval
 lval* lval_lambda(lval* formals, lval* body) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_FUN;
+  lval* v = lval_new(LVAL_FUN);
 
   //Set builtin to null to indicate lambda
   v->builtin = NULL;
 
   //Build enviornment and set vals
-  v->env = lenv_new();
+  v->env = lenv_frame(formals);
   v->formals = formals;
   v->body = body;
+  v->code = NULL;
   return v;
 }
 
+lval* lval_map(void) {
+  lval* v = lval_new(LVAL_MAP);
+  v->map = NULL;
+  return v;
+}
+
+//Construct a vector of n numbers, left for the caller to fill in
+lval* lval_vec(long n, int dbl) {
+  lval* v = lval_new(LVAL_VEC);
+  v->vlen = n;
+  v->vdbl = dbl;
+  v->ints = malloc(sizeof(int64_t) * (n ? n : 1));
+  return v;
+}
+
+//Wrap a future, taking over the reference given
+lval* lval_fut(struct lfuture* fut) {
+  lval* v = lval_new(LVAL_FUT);
+  v->fut = fut;
+  return v;
+}
+
+//Take another reference to v, the value itself is shared
 lval* lval_copy(lval* v) {
-  lval* x = malloc(sizeof(lval));
-  x->type = v->type;
+  v->refs++;
+  return v;
+}
+
+//Consume a reference to v and return a value that is safe to modify.
+//Shared values are copied one level deep, children stay shared. The cells
+//of an expression stay in the same buffer, see lval_reserve.
+lval* lval_unshare(lval* v) {
+  if (v->refs == 1) { return v; }
+
+  lval* x = lval_new(v->type);
 
   switch (v->type) {
     //Copy numbers and functions directly
     case LVAL_NUM: x->num = v->num; break;
+    case LVAL_DBL: x->dbl = v->dbl; break;
+    case LVAL_BIG: x->big = big_copy(v->big); break;
     case LVAL_FUN:
       if (v->builtin) {
         x->builtin = v->builtin;
@@ -236,69 +446,270 @@ lval* lval_copy(lval* v) {
         x->env = lenv_copy(v->env);
         x->formals = lval_copy(v->formals);
         x->body = lval_copy(v->body);
+        x->code = v->code;
+        if (x->code) { x->code->refs++; }
       }
     break;
 
     case LVAL_ERR: x->err = malloc(strlen(v->err)+1); strcpy(x->err, v->err); break;
-    case LVAL_SYM: x->sym = malloc(strlen(v->sym)+1); strcpy(x->sym, v->sym); break;
+    case LVAL_SYM: x->sym = v->sym; break;
     case LVAL_STR: x->str = malloc(strlen(v->str)+1); strcpy(x->str, v->str); break;
 
     case LVAL_SEXPR:
     case LVAL_QEXPR:
       x->count = v->count;
-      x->cell = malloc(sizeof(lval*) * x->count);
-      for (int i = 0; i < x->count; i++) {
-        x->cell[i] = lval_copy(v->cell[i]);
+      x->cell = v->cell;
+      x->buf = v->buf;
+      if (x->buf) { x->buf->refs++; }
+    break;
+
+    //Entries are copied in order, keys and values stay shared
+    case LVAL_MAP:
+      x->map = NULL;
+      for (struct lentry* en = v->map; en; en = en->hh.next) {
+        x = lval_map_put(x, lval_copy(en->key), lval_copy(en->val));
       }
     break;
+
+    case LVAL_VEC:
+      x->vlen = v->vlen;
+      x->vdbl = v->vdbl;
+      x->ints = malloc(sizeof(int64_t) * (v->vlen ? v->vlen : 1));
+      memcpy(x->ints, v->ints, sizeof(int64_t) * v->vlen);
+    break;
+
+    case LVAL_FUT: x->fut = pool_future_copy(v->fut); break;
   }
 
+  v->refs--;
   return x;
 }
 
 // Properly free all memory allocated for an lval
 void lval_del(lval* v) {
+  //Value is still referenced elsewhere
+  if (--v->refs > 0) { return; }
+
+  lval_clear(v);
+
+  //Free the lval itself
+  if (gc_enabled) {
+    gc_free(v, lval_size(v->type));
+  } else {
+    lfree(v, lval_size(v->type));
+  }
+}
+
+//Release everything v holds, leaving the cell itself allocated
+void lval_clear(lval* v) {
   switch (v->type) {
-    // Do nothing special for numbers or functions
+    // Do nothing special for numbers, symbols are owned by the intern table
     case LVAL_NUM: break;
+    case LVAL_DBL: break;
+    case LVAL_BIG: big_del(v->big); break;
+    case LVAL_SYM: break;
     case LVAL_FUN:
       if (!v->builtin) {
         lenv_del(v->env);
         lval_del(v->formals);
         lval_del(v->body);
+        if (v->code) { vm_code_del(v->code); }
       }
     break;
 
     // Free character buffers storing commands
     case LVAL_ERR: free(v->err); break;
-    case LVAL_SYM: free(v->sym); break;
     case LVAL_STR: free(v->str); break;
 
     case LVAL_QEXPR:
     case LVAL_SEXPR:
-      for (int i = 0; i < v->count; i++) {
-        lval_del(v->cell[i]);
-      }
-      free(v->cell);
+      if (v->buf) { lcells_del(v->buf); }
     break;
+
+    case LVAL_MAP: {
+      struct lentry *en, *tmp;
+      HASH_ITER(hh, v->map, en, tmp) {
+        HASH_DEL(v->map, en);
+        lval_del(en->key);
+        lval_del(en->val);
+        lfree(en, sizeof(struct lentry));
+      }
+    } break;
+
+    case LVAL_VEC: free(v->ints); break;
+    case LVAL_FUT: pool_future_del(v->fut); break;
   }
-  //Free the lval itself
-  free(v);
 }
 
-//Add a new s-expression to the chain
+//Bytes in a cell buffer with room for cap items. Buffers come from the
+//slab allocator so short argument lists are recycled through its free
+//lists instead of going to malloc.
+static size_t lcells_size(int cap) {
+  return offsetof(struct lcells, items) + sizeof(lval*) * cap;
+}
+
+//Release a reference to a cell buffer, deleting its items once unused
+void lcells_del(struct lcells* b) {
+  if (--b->refs > 0) { return; }
+
+  for (int i = b->lo; i < b->used; i++) {
+    if (b->items[i]) { lval_del(b->items[i]); }
+  }
+  lfree(b, lcells_size(b->cap));
+}
+
+//Give v, which must not be shared, a buffer of its own with room for n
+//cells from the first. Cells shared with other expressions are copied.
+lval* lval_reserve(lval* v, int n) {
+  struct lcells* b = v->buf;
+  int own = b && b->refs == 1;
+  if (own) {
+    //Nothing else can see items past the end of the view
+    int start = v->cell - b->items;
+    for (int i = start + v->count; i < b->used; i++) {
+      if (b->items[i]) { lval_del(b->items[i]); b->items[i] = NULL; }
+    }
+    b->used = start + v->count;
+    if (start + n <= b->cap) { return v; }
+
+    //Grow in place when the view starts the buffer
+    if (v->cell == b->items) {
+      b = lrealloc(b, lcells_size(b->cap), lcells_size(n));
+      b->cap = n;
+      v->buf = b;
+      v->cell = b->items;
+      return v;
+    }
+  }
+  if (n == 0) { return v; }
+
+  struct lcells* nb = lalloc(lcells_size(n));
+  nb->refs = 1;
+  nb->cap = n;
+  nb->lo = 0;
+  nb->used = v->count;
+  for (int i = 0; i < v->count; i++) {
+    if (own) {
+      nb->items[i] = v->cell[i];
+      v->cell[i] = NULL;
+    } else {
+      nb->items[i] = lval_copy(v->cell[i]);
+    }
+  }
+
+  if (b) { lcells_del(b); }
+  v->buf = nb;
+  v->cell = nb->items;
+  return v;
+}
+
+//Set the number of cells in v, which must not be shared. New cells are
+//left for the caller to fill and dropped cells are not deleted.
+lval* lval_resize(lval* v, int count) {
+  lval_reserve(v, count > v->count ? count : v->count);
+
+  for (int i = count; i < v->count; i++) { v->cell[i] = NULL; }
+  for (int i = v->count; i < count; i++) { v->cell[i] = NULL; }
+  v->count = count;
+
+  if (count == 0) {
+    if (v->buf) { lcells_del(v->buf); }
+    v->buf = NULL;
+    v->cell = NULL;
+  } else {
+    int end = (v->cell - v->buf->items) + count;
+    if (end > v->buf->used) { v->buf->used = end; }
+  }
+  return v;
+}
+
+//Room to reserve for v to hold n cells. A full buffer is at least
+//doubled so a run of appends costs amortized O(1) each.
+static int lval_grow(lval* v, int n) {
+  struct lcells* b = v->buf;
+  if (b && b->refs == 1 && (v->cell - b->items) + n <= b->cap) { return n; }
+  if (n < 4) { return 4; }
+  return n > v->count * 2 ? n : v->count * 2;
+}
+
+//Make room for n more cells at the end of v, which must not be shared.
+//A view ending where its buffer is used up claims the free slots after
+//it even when the buffer is shared, so appending to a list that is also
+//bound elsewhere copies nothing.
+static lval* lval_room(lval* v, int n) {
+  struct lcells* b = v->buf;
+  if (b && b->refs > 1) {
+    int end = (v->cell - b->items) + v->count;
+    if (end == b->used && end + n <= b->cap) { return v; }
+  }
+  return lval_reserve(v, lval_grow(v, v->count + n));
+}
+
+//Add a new s-expression to the chain, v must not be shared
 lval* lval_add(lval* v, lval* x) {
+  v = lval_room(v, 1);
+  v->cell[v->count++] = x;
+  v->buf->used = (v->cell - v->buf->items) + v->count;
+  return v;
+}
+
+//Add x in front of the cells of v, which must not be shared. Slots below
+//lo are claimed as lval_room claims those past used, and a buffer that
+//has none left is replaced by one with its free space in front, so a run
+//of prepends costs amortized O(1) each.
+lval* lval_prepend(lval* v, lval* x) {
+  struct lcells* b = v->buf;
+  int start = b ? v->cell - b->items : 0;
+  int own = b && b->refs == 1;
+
+  //Nothing else can see items before the view of a buffer it owns
+  if (own) {
+    for (int i = b->lo; i < start; i++) {
+      if (b->items[i]) { lval_del(b->items[i]); b->items[i] = NULL; }
+    }
+    b->lo = start;
+  }
+
+  if (!b || start != b->lo || b->lo == 0) {
+    int cap = (v->count + 1) * 2;
+    if (cap < 4) { cap = 4; }
+    struct lcells* nb = lalloc(lcells_size(cap));
+    nb->refs = 1;
+    nb->cap = cap;
+    nb->lo = cap - v->count;
+    nb->used = cap;
+    for (int i = 0; i < v->count; i++) {
+      if (own) {
+        nb->items[nb->lo + i] = v->cell[i];
+        v->cell[i] = NULL;
+      } else {
+        nb->items[nb->lo + i] = lval_copy(v->cell[i]);
+      }
+    }
+
+    if (b) { lcells_del(b); }
+    b = nb;
+    v->buf = nb;
+    v->cell = nb->items + nb->lo;
+  }
+
+  b->items[--b->lo] = x;
+  v->cell--;
   v->count++;
-  v->cell = realloc(v->cell, sizeof(lval*) * v->count);
-  v->cell[v->count-1] = x;
   return v;
 }
 
-//Build a number lval from an identified numeric in the AST
+//Build a number lval from an identified numeric in the AST, numbers
+//with a fraction or exponent are read as floats
 lval* lval_read_num(mpc_ast_t* t) {
   errno = 0;
+  if (strpbrk(t->contents, ".eE")) {
+    double x = strtod(t->contents, NULL);
+    return errno != ERANGE || fabs(x) != HUGE_VAL ? lval_dbl(x) : lval_err("Invalid number");
+  }
   long x = strtol(t->contents, NULL, 10);
-  return errno != ERANGE ? lval_num(x) : lval_err("Invalid number");
+  if (errno == ERANGE) { return lval_big(big_from_dec(t->contents, strlen(t->contents))); }
+  return lval_num(x);
 }
 
 lval* lval_read_str(mpc_ast_t* t) {
@@ -328,6 +739,9 @@ lval* lval_read(mpc_ast_t* t) {
   if (strstr(t->tag, "sexpr"))  { x = lval_sexpr(); }
   if (strstr(t->tag, "qexpr"))  { x = lval_qexpr(); }
 
+  //Every child bar the brackets becomes a cell, so size it once
+  x = lval_reserve(x, t->children_num);
+
   //Fill list with any valid expressions inside
   for (int i = 0; i < t->children_num; i++) {
     if (strcmp(t->children[i]->contents, "(") == 0) { continue; }
@@ -344,14 +758,36 @@ lval* lval_read(mpc_ast_t* t) {
 
 //Extract element from list at index i
 lval* lval_pop(lval* v, int i) {
-  lval* x = v->cell[i];
-
-  //Shift memory over location i and decrement list count
-  memmove(&v->cell[i], &v->cell[i+1], sizeof(lval*) * (v->count-i-1));
-  v->count--;
+  lval* x;
+
+  if (i == 0 || i == v->count-1) {
+    //Either end is popped by narrowing the view. A shared buffer keeps
+    //its items, so the caller is given a reference of its own.
+    struct lcells* b = v->buf;
+    if (b->refs == 1) {
+      x = v->cell[i];
+      v->cell[i] = NULL;
+      //Give the slot back so it can be claimed again
+      if (i == 0 && v->cell == b->items + b->lo) { b->lo++; }
+      if (i != 0 && v->cell + i + 1 == b->items + b->used) { b->used--; }
+    } else {
+      x = lval_copy(v->cell[i]);
+    }
+    if (i == 0) { v->cell++; }
+    v->count--;
+  } else {
+    //Shift memory over location i and shrink the list
+    lval_reserve(v, v->count);
+    x = v->cell[i];
+    memmove(&v->cell[i], &v->cell[i+1], sizeof(lval*) * (v->count-i-1));
+    v->cell[--v->count] = NULL;
+  }
 
-  //Reallocate for new sized array and return popped elem
-  v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+  if (v->count == 0) {
+    lcells_del(v->buf);
+    v->buf = NULL;
+    v->cell = NULL;
+  }
   return x;
 }
 
@@ -364,17 +800,103 @@ lval* lval_take(lval* v, int i) {
 
 //Add each cell in y to x
 lval* lval_join(lval* x, lval* y) {
-  while (y->count) {
-    x = lval_add(x, lval_pop(y, 0));
+  //Joining onto nothing gives y as it is
+  if (x->count == 0 && x->type == y->type) {
+    lval_del(x);
+    return y;
+  }
+
+  x = lval_unshare(x);
+  x = lval_room(x, y->count);
+  for (int i = 0; i < y->count; i++) {
+    x->cell[x->count++] = lval_copy(y->cell[i]);
   }
+  if (x->buf) { x->buf->used = (x->cell - x->buf->items) + x->count; }
 
   lval_del(y);
   return x;
 }
 
-lval* lval_call(lenv* e, lval* f, lval* a) {
-  // If builtin then apply that
-  if (f->builtin) { return f->builtin(e, a); }
+//Check k can be used as a map key
+int lval_hashable(lval* k) {
+  return k->type == LVAL_NUM || k->type == LVAL_SYM || k->type == LVAL_STR;
+}
+
+//Find the bytes k is hashed by. Each kind of key ends in a different
+//byte, a string in its terminator, so keys of different types never
+//match. Numbers and symbols are written to id, strings are used in place.
+static char* lmap_key(lval* k, char* id, size_t* len) {
+  if (k->type == LVAL_STR) {
+    *len = strlen(k->str) + 1;
+    return k->str;
+  }
+  if (k->type == LVAL_NUM) {
+    memcpy(id, &k->num, sizeof(long));
+    id[sizeof(long)] = 'n';
+    *len = sizeof(long) + 1;
+  } else {
+    memcpy(id, &k->sym, sizeof(char*));
+    id[sizeof(char*)] = 's';
+    *len = sizeof(char*) + 1;
+  }
+  return id;
+}
+
+static struct lentry* lmap_find(lval* m, lval* k) {
+  char id[sizeof(long) + sizeof(char*)];
+  size_t len;
+  char* key = lmap_key(k, id, &len);
+
+  struct lentry* en;
+  HASH_FIND(hh, m->map, key, len, en);
+  return en;
+}
+
+//Value bound to k in m, NULL if there is none. The map keeps its reference.
+lval* lval_map_get(lval* m, lval* k) {
+  struct lentry* en = lmap_find(m, k);
+  return en ? en->val : NULL;
+}
+
+//Bind k to v in m, which must not be shared. Takes the references to k and
+//v, a key already present keeps its place and has its value replaced.
+lval* lval_map_put(lval* m, lval* k, lval* v) {
+  struct lentry* en = lmap_find(m, k);
+  if (en) {
+    lval_del(en->val);
+    en->val = v;
+    lval_del(k);
+    return m;
+  }
+
+  //The key is held by the entry so a string key stays valid
+  en = lalloc(sizeof(struct lentry));
+  en->key = k;
+  en->val = v;
+  size_t len;
+  char* key = lmap_key(k, en->id, &len);
+  HASH_ADD_KEYPTR(hh, m->map, key, len, en);
+  return m;
+}
+
+//Remove k from m, which must not be shared
+lval* lval_map_del(lval* m, lval* k) {
+  struct lentry* en = lmap_find(m, k);
+  if (en) {
+    HASH_DEL(m->map, en);
+    lval_del(en->key);
+    lval_del(en->val);
+    lfree(en, sizeof(struct lentry));
+  }
+  return m;
+}
+
+//Bind arguments a to the formals of lambda f. Returns a private copy of
+//f holding the bindings, which still has formals left if partially applied.
+lval* lval_bind(lenv* e, lval* f, lval* a) {
+  // Take a private copy of the lambda, binding modifies its env and formals
+  f = lval_unshare(lval_copy(f));
+  f->formals = lval_unshare(f->formals);
 
   // Store argument counts
   int given = a->count;
@@ -384,7 +906,8 @@ lval* lval_call(lenv* e, lval* f, lval* a) {
   while (a->count) {
     // Ran out of formals to bind, return error
     if (f->formals->count == 0) {
-      lval_del(a); return lval_err("Function passed too many arguments, Got %i, Expected %i.", given, total);
+      lval_del(a); lval_del(f);
+      return lval_err("Function passed too many arguments, Got %i, Expected %i.", given, total);
     }
 
     // pop first symbol from formals
@@ -393,7 +916,7 @@ lval* lval_call(lenv* e, lval* f, lval* a) {
     if (strcmp(sym->sym, "&") == 0) {
       //Ensure & is followed by another symbol
       if (f->formals->count != 1) {
-        lval_del(a);
+        lval_del(a); lval_del(sym); lval_del(f);
         return lval_err("Function formal invalid. Symbol '&' not followed by single symbol.");
       }
 
@@ -416,6 +939,7 @@ lval* lval_call(lenv* e, lval* f, lval* a) {
 
   if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") == 0) {
     if (f->formals->count != 2) {
+      lval_del(f);
       return lval_err("Function format invalid. Symbol '&' not followed by a single symbol");
     }
 
@@ -428,52 +952,127 @@ lval* lval_call(lenv* e, lval* f, lval* a) {
     lval_del(sym); lval_del(val);
   }
 
-  // If all formals bound, evaluate
-  if (f->formals->count == 0) {
-    // set function enviornment parent to current eval enviornment
-    f->env->par = e;
+  return f;
+}
 
-    return builtin_eval(f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
-  } else {
-    // return partially evaluated function
-    return lval_copy(f);
+lval* lval_call(lenv* e, lval* f, lval* a) {
+  // If builtin then apply that
+  if (f->builtin) { return f->builtin(e, a); }
+
+  // Compile before binding so the cached code is shared with f
+  if (vm_enabled) { vm_code(f); }
+
+  // Return errors and partially evaluated functions
+  f = lval_bind(e, f, a);
+  if (f->type == LVAL_ERR || f->formals->count > 0) { return f; }
+
+  // set function enviornment parent to current eval enviornment
+  f->env->par = e;
+
+  if (vm_enabled) { return vm_apply(f); }
+
+  lval* result = builtin_eval(f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
+  lval_del(f);
+  return result;
+}
+
+//Check whether every variable in outer is hidden by a slot of inner, in
+//which case outer can be dropped from the chain under inner
+int lenv_shadows(lenv* inner, lenv* outer) {
+  if (outer->vars) { return 0; }
+  if (!outer->slots || outer->slots == inner->slots) { return 1; }
+
+  for (int i = 0; i < outer->slots->count; i++) {
+    if (lenv_slot(inner, outer->slots->cell[i]->sym) < 0) { return 0; }
   }
+  return 1;
 }
 
-//Evaluate an s-expression
+//Evaluate an s-expression. Calls in tail position (lambda bodies, the
+//branch taken by if, eval) loop here instead of recursing.
 lval* lval_eval_sexpr(lenv* e, lval* v) {
+  //Lambda whose body is being evaluated, owns e
+  lval* owner = NULL;
+  //Earlier lambdas still visible to owner through the environment chain
+  lval* held = NULL;
+  lval* result;
+
+  while (1) {
+    //Evaluation replaces children in place
+    v = lval_unshare(v);
+    v = lval_reserve(v, v->count);
+
+    //Eval children
+    for (int i = 0; i < v->count; i++) {
+      v->cell[i] = lval_eval(e, v->cell[i]);
+    }
 
-  //Eval children
-  for (int i = 0; i < v->count; i++) {
-    v->cell[i] = lval_eval(e, v->cell[i]);
-  }
+    //Error checking
+    int err = -1;
+    for (int i = 0; i < v->count; i++) {
+      if (v->cell[i]->type == LVAL_ERR) { err = i; break; }
+    }
+    if (err >= 0) { result = lval_take(v, err); break; }
 
-  //Error checking
-  for (int i = 0; i < v->count; i++) {
-    if (v->cell[i]->type == LVAL_ERR) { return lval_take(v, i); }
-  }
+    //Empty expression
+    if (v->count == 0) { result = v; break; }
+
+    //Single expression
+    if (v->count == 1) { result = lval_take(v, 0); break; }
 
-  //Empty expression
-  if (v->count == 0) { return v; }
+    //Ensure element is function after evaluation
+    lval* f = lval_pop(v, 0);
+    if (f->type != LVAL_FUN) {
+      lval_del(f);
+      lval_del(v);
+      result = lval_err("First element is not a function.");
+      break;
+    }
 
-  //Single expression
-  if (v->count == 1) { return lval_take(v, 0); }
+    //Continue with the expression if and eval would evaluate
+    if (f->builtin == builtin_if || f->builtin == builtin_eval) {
+      lval* x = f->builtin == builtin_if ? builtin_if_branch(v) : builtin_eval_expr(v);
+      lval_del(f);
+      if (x->type == LVAL_ERR) { result = x; break; }
+      v = x;
+      continue;
+    }
 
-  //Ensure element is function after evaluation
-  lval* f = lval_pop(v, 0);
-  if (f->type != LVAL_FUN) {
+    //Call builtin with operator
+    if (f->builtin) {
+      result = f->builtin(e, v);
+      lval_del(f);
+      break;
+    }
+
+    //Bind lambda, errors and partially evaluated functions are results
+    lval* g = lval_bind(e, f, v);
     lval_del(f);
-    lval_del(v);
-    return lval_err("First element is not a function.");
+    if (g->type == LVAL_ERR || g->formals->count > 0) { result = g; break; }
+
+    //Enter the body, dropping the current lambda if nothing in it is visible
+    g->env->par = e;
+    if (owner && lenv_shadows(g->env, owner->env)) {
+      g->env->par = owner->env->par;
+      lval_del(owner);
+    } else if (owner) {
+      if (!held) { held = lval_qexpr(); }
+      held = lval_add(held, owner);
+    }
+    owner = g;
+    e = g->env;
+
+    v = lval_unshare(lval_copy(g->body));
+    v->type = LVAL_SEXPR;
   }
 
-  //Call builtin with operator
-  lval* result = lval_call(e, f, v);
-  lval_del(f);
+  if (owner) { lval_del(owner); }
+  if (held) { lval_del(held); }
   return result;
 }
 
 lval* lval_eval(lenv* e, lval* v) {
+  if (vm_enabled && v->type == LVAL_SEXPR) { return vm_eval(e, v); }
   if (v->type == LVAL_SYM) {
     lval* x = lenv_get(e, v);
     lval_del(v);
@@ -483,13 +1082,26 @@ lval* lval_eval(lenv* e, lval* v) {
   return v;
 }
 
+//Check a float holds exactly the integer n
+static int lval_dbl_is(double d, long n) {
+  return d >= -9223372036854775808.0 && d < 9223372036854775808.0
+      && (long)d == n && (double)(long)d == d;
+}
+
 int lval_eq(lval* x, lval* y) {
+  //Numbers compare by value whatever their representation
+  if (x->type == LVAL_NUM && y->type == LVAL_DBL) { return lval_dbl_is(y->dbl, x->num); }
+  if (x->type == LVAL_DBL && y->type == LVAL_NUM) { return lval_dbl_is(x->dbl, y->num); }
+  if (x->type == LVAL_DBL && y->type == LVAL_BIG) { return x->dbl == big_to_dbl(y->big); }
+  if (x->type == LVAL_BIG && y->type == LVAL_DBL) { return big_to_dbl(x->big) == y->dbl; }
   if (x->type != y->type) { return 0; }
 
   switch (x->type) {
     case LVAL_NUM: return x->num == y->num;
+    case LVAL_DBL: return x->dbl == y->dbl;
+    case LVAL_BIG: return big_cmp(x->big, y->big) == 0;
     case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
-    case LVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
+    case LVAL_SYM: return x->sym == y->sym;
     case LVAL_STR: return (strcmp(x->str, y->str) == 0);
     case LVAL_FUN:
       if (x->builtin || y->builtin) {
@@ -505,6 +1117,34 @@ int lval_eq(lval* x, lval* y) {
       }
       return 1;
     break;
+
+    //Maps are equal with the same bindings in any order
+    case LVAL_MAP:
+      if (HASH_COUNT(x->map) != HASH_COUNT(y->map)) { return 0; }
+      for (struct lentry* en = x->map; en; en = en->hh.next) {
+        lval* v = lval_map_get(y, en->key);
+        if (!v || !lval_eq(en->val, v)) { return 0; }
+      }
+      return 1;
+
+    //Vectors are equal holding equal numbers, 1 and 1.0 alike
+    case LVAL_VEC:
+      if (x->vlen != y->vlen) { return 0; }
+      for (long i = 0; i < x->vlen; i++) {
+        if (x->vdbl && y->vdbl) {
+          if (x->dbls[i] != y->dbls[i]) { return 0; }
+        } else if (x->vdbl || y->vdbl) {
+          double d = x->vdbl ? x->dbls[i] : y->dbls[i];
+          long n = x->vdbl ? y->ints[i] : x->ints[i];
+          if (!lval_dbl_is(d, n)) { return 0; }
+        } else if (x->ints[i] != y->ints[i]) {
+          return 0;
+        }
+      }
+      return 1;
+
+    //Futures are only equal to themselves
+    case LVAL_FUT: return x->fut == y->fut;
   }
   return 0;
 }
@@ -523,6 +1163,39 @@ void lval_expr_print(lval* v, char open, char close) {
   putchar(close);
 }
 
+//Print the bindings of a map in the order they were added
+void lval_map_print(lval* v) {
+  putchar('[');
+  for (struct lentry* en = v->map; en; en = en->hh.next) {
+    lval_print(en->key);
+    putchar(' ');
+    lval_print(en->val);
+    if (en->hh.next) { putchar(' '); }
+  }
+  putchar(']');
+}
+
+//Print a float with the fewest digits that read back as the same value,
+//keeping a decimal point so it is not mistaken for an integer
+void lval_print_dbl(double x) {
+  char buf[32];
+  for (int digits = 15; digits <= 17; digits++) {
+    snprintf(buf, sizeof(buf), "%.*g", digits, x);
+    if (strtod(buf, NULL) == x) { break; }
+  }
+  if (isfinite(x) && !strpbrk(buf, ".e")) { strcat(buf, ".0"); }
+  printf("%s", buf);
+}
+
+void lval_vec_print(lval* v) {
+  printf("#(");
+  for (long i = 0; i < v->vlen; i++) {
+    if (v->vdbl) { lval_print_dbl(v->dbls[i]); } else { printf("%li", (long)v->ints[i]); }
+    if (i != v->vlen-1) { putchar(' '); }
+  }
+  putchar(')');
+}
+
 void lval_print_str(lval* v) {
   // Copy the string
   char* escaped = malloc(strlen(v->str)+1);
@@ -537,11 +1210,20 @@ void lval_print_str(lval* v) {
 void lval_print(lval* v) {
   switch(v->type) {
     case LVAL_NUM: printf("%li", v->num); break;
+    case LVAL_DBL: lval_print_dbl(v->dbl); break;
+    case LVAL_BIG: {
+      char* s = big_to_dec(v->big);
+      printf("%s", s);
+      free(s);
+    } break;
     case LVAL_ERR: printf("Error: %s", v->err); break;
     case LVAL_SYM: printf("%s", v->sym); break;
     case LVAL_STR: lval_print_str(v); break;
     case LVAL_SEXPR: lval_expr_print(v, '(', ')'); break;
     case LVAL_QEXPR: lval_expr_print(v, '{', '}'); break;
+    case LVAL_MAP: lval_map_print(v); break;
+    case LVAL_VEC: lval_vec_print(v); break;
+    case LVAL_FUT: printf("<future>"); break;
     case LVAL_FUN:
       if (v->builtin) {
         printf("<builtin>");
@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include "mpc.h"
 #include "uthash.h"
 
@@ -7,44 +8,99 @@
 // Forward declarations
 struct lval;
 struct lenv;
+struct lcode;
+struct lentry;
+struct lbig;
+struct lfuture;
 typedef struct lval lval;
 typedef struct lenv lenv;
-
-// Parser forward declarations
-mpc_parser_t* number;
-mpc_parser_t* symbol;
-mpc_parser_t* string;
-mpc_parser_t* comment;
-mpc_parser_t* sexpr;
-mpc_parser_t* qexpr;
-mpc_parser_t* expr;
-mpc_parser_t* blisp;
+typedef struct lcode lcode;
 
 // Enumeration of value types and error types
-typedef enum {LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_STR, LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR} ltype_t;
+typedef enum {LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_STR, LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR, LVAL_MAP, LVAL_DBL, LVAL_BIG, LVAL_VEC, LVAL_FUT} ltype_t;
 
 typedef lval*(*lbuiltin)(lenv*, lval*);
 
-// Lisp value type
+// Lisp value type. Only the members for the type are present, cells
+// are allocated with just enough room for them (see lval_size).
 struct lval {
   ltype_t type;
 
-  // Basic values
-  long num;
-  char* err;
-  char* sym;
-  char* str;
+  // Number of live references, shared values are copied on write
+  int refs;
+
+  union {
+    // Basic values
+    long num;
+    double dbl;
+    struct lbig* big; // Only for values outside the range of long
+    char* err;
+    char* sym;      // Interned, see lsym_intern
+    char* str;
+
+    // Function
+    struct {
+      lbuiltin builtin;
+      lenv* env;
+      lval* formals;
+      lval* body;
+      lcode* code;
+    };
+
+    // Expressions, cell is a view of count items in buf
+    struct {
+      int count;
+      struct lval** cell;
+      struct lcells* buf;
+    };
+
+    // Map, a uthash table in insertion order
+    struct lentry* map;
+
+    // Vector, vlen unboxed numbers which are all floats if vdbl is set
+    struct {
+      long vlen;
+      int vdbl;
+      union {
+        int64_t* ints;
+        double* dbls;
+      };
+    };
+
+    // Result of a call running in the background, see pool_spawn
+    struct lfuture* fut;
+  };
+};
 
-  // Function
-  lbuiltin builtin;
-  lenv* env;
-  lval* formals;
-  lval* body;
+// Storage for expression cells. Expressions popped from either end or
+// unshared keep viewing the same buffer, which holds a reference to each
+// item from lo up to used that is not NULL. Slots outside that range have
+// never been seen by any view, so a view reaching lo or used may claim
+// them to grow in place even while the buffer is shared.
+struct lcells {
+  int refs;
+  int cap;
+  int lo;
+  int used;
+  lval* items[];
+};
 
-  int count;
-  struct lval** cell;
+// Map entry. Numbers, symbols and strings can be keys, they are hashed
+// by the bytes lmap_key gives for them.
+struct lentry {
+  lval* key;
+  lval* val;
+  char id[sizeof(long) + sizeof(char*)];
+  UT_hash_handle hh;
 };
 
+// Interned symbol name
+struct lsym {
+  char* name;
+  UT_hash_handle hh;
+};
+
+// Variable binding, keyed by interned symbol pointer
 struct lvar {
   char* sym;
   lval* val;
@@ -53,11 +109,24 @@ struct lvar {
 
 struct lenv {
   lenv* par;
+
+  // Lambda frames hold formals in flat slots, slots is a q-expression
+  // of the names shared between copies of the frame
+  lval* slots;
+  lval** vals;
+
   struct lvar* vars;
 };
 
+//Symbol functions
+char* lsym_intern(char* name);
+char* lsym_intern_len(char* name, size_t len);
+
 //Environment functions
 lenv* lenv_new(void);
+lenv* lenv_frame(lval* formals);
+int lenv_slot(lenv* e, char* sym);
+int lenv_shadows(lenv* inner, lenv* outer);
 void lenv_iter(lenv* e);
 void lenv_del(lenv* e);
 lval* lenv_get(lenv* e, lval* k);
@@ -69,29 +138,50 @@ void lenv_add_builtin(lenv* e, char* name, lbuiltin func);
 void lenv_add_builtins(lenv* e);
 
 //Constructors
+size_t lval_size(ltype_t type);
+lval* lval_new(ltype_t type);
 lval* lval_num(long x);
+lval* lval_dbl(double x);
+lval* lval_big(struct lbig* b);
 lval* lval_err(char* fmt, ...);
 lval* lval_sym(char* s);
+lval* lval_sym_len(char* s, size_t len);
 lval* lval_str(char* s);
 lval* lval_fun(lbuiltin func);
 lval* lval_sexpr(void);
 lval* lval_qexpr(void);
 lval* lval_lambda(lval* formals, lval* body);
+lval* lval_map(void);
+lval* lval_vec(long n, int dbl);
+lval* lval_fut(struct lfuture* fut);
 
 lval* lval_copy(lval* v);
+lval* lval_unshare(lval* v);
 
 //Destructor
 void lval_del(lval* v);
+void lval_clear(lval* v);
 
 //parser functions
+void lcells_del(struct lcells* b);
+lval* lval_reserve(lval* v, int n);
+lval* lval_resize(lval* v, int count);
 lval* lval_add(lval* v, lval* x);
+lval* lval_prepend(lval* v, lval* x);
 lval* lval_read_num(mpc_ast_t* t);
 lval* lval_read(mpc_ast_t* t);
 
+//Map functions
+int lval_hashable(lval* k);
+lval* lval_map_get(lval* m, lval* k);
+lval* lval_map_put(lval* m, lval* k, lval* v);
+lval* lval_map_del(lval* m, lval* k);
+
 //Evaluator functions
 lval* lval_pop(lval* v, int i);
 lval* lval_take(lval* v, int i);
 lval* lval_join(lval* x, lval* y);
+lval* lval_bind(lenv* e, lval* f, lval* a);
 lval* lval_call(lenv* e, lval* f, lval* a);
 
 lval* lval_eval_sexpr(lenv* e, lval* v);
@@ -102,6 +192,9 @@ int lval_eq(lval* x, lval* y);
 
 //Pretty printing objects
 void lval_expr_print(lval* v, char first, char last);
+void lval_map_print(lval* v);
+void lval_vec_print(lval* v);
+void lval_print_dbl(double x);
 void lval_print(lval* v);
 void lval_println(lval* v);
 
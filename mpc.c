@@ -1,5 +1,13 @@
 #include "mpc.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define MPC_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /*
 ** State Type
 */
@@ -303,7 +311,8 @@ static mpc_err_t *mpc_err_count(mpc_err_t *x, int n) {
 enum {
   MPC_INPUT_STRING = 0,
   MPC_INPUT_FILE   = 1,
-  MPC_INPUT_PIPE   = 2
+  MPC_INPUT_PIPE   = 2,
+  MPC_INPUT_MMAP   = 3
 };
 
 typedef struct {
@@ -315,6 +324,7 @@ typedef struct {
   char *string;
   char *buffer;
   FILE *file;
+  long length;
   
   int backtrack;
   int marks_num;
@@ -366,6 +376,33 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   
 }
 
+/*
+** Mapped input reads straight out of the mapped
+** pages. The data need not be null terminated and
+** is not owned by the input.
+*/
+
+static mpc_input_t *mpc_input_new_mmap(const char *filename, char *data, long length) {
+  
+  mpc_input_t *i = malloc(sizeof(mpc_input_t));
+  
+  i->filename = malloc(strlen(filename) + 1);
+  strcpy(i->filename, filename);
+  i->type = MPC_INPUT_MMAP;
+  i->state = mpc_state_new();
+  
+  i->string = data;
+  i->buffer = NULL;
+  i->file = NULL;
+  i->length = length;
+  
+  i->backtrack = 1;
+  i->marks_num = 0;
+  i->marks = NULL;
+  
+  return i;
+}
+
 static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
@@ -453,6 +490,7 @@ static int mpc_input_terminated(mpc_input_t *i) {
   if (i->type == MPC_INPUT_STRING && i->state.pos == strlen(i->string)) { return 1; }
   if (i->type == MPC_INPUT_FILE && feof(i->file)) { return 1; }
   if (i->type == MPC_INPUT_PIPE && feof(i->file)) { return 1; }
+  if (i->type == MPC_INPUT_MMAP && i->state.pos >= i->length) { return 1; }
   return 0;
 }
 
@@ -462,6 +500,7 @@ static char mpc_input_getc(mpc_input_t *i) {
   switch (i->type) {
     
     case MPC_INPUT_STRING: c = i->string[i->state.pos]; break;
+    case MPC_INPUT_MMAP: c = i->state.pos < i->length ? i->string[i->state.pos] : '\0'; break;
     case MPC_INPUT_FILE: c = fgetc(i->file); break;
     case MPC_INPUT_PIPE:
     
@@ -484,6 +523,7 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
 
   switch (i->type) {
     case MPC_INPUT_STRING: break;
+    case MPC_INPUT_MMAP: break;
     case MPC_INPUT_FILE: fseek(i->file, -1, SEEK_CUR); break;
     case MPC_INPUT_PIPE:
       
@@ -1140,11 +1180,37 @@ int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result
   return x;
 }
 
+int mpc_parse_mmap(const char *filename, char *data, long length, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_mmap(filename, data, length);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
   
-  FILE *f = fopen(filename, "rb");
+  FILE *f;
   int res;
   
+#ifdef MPC_HAVE_MMAP
+  /* Regular files are mapped and parsed in place */
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      close(fd);
+      res = mpc_parse_mmap(filename, data, st.st_size, p, r);
+      munmap(data, st.st_size);
+      return res;
+    }
+  }
+  if (fd >= 0) { close(fd); }
+#endif
+  
+  f = fopen(filename, "rb");
+  
   if (f == NULL) {
     r->output = NULL;
     r->error = mpc_err_fail(filename, mpc_state_new(), "Unable to open file!");
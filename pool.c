@@ -0,0 +1,520 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lval.h"
+#include "vm.h"
+#include "reader.h"
+#include "image.h"
+#include "pool.h"
+#include "uthash.h"
+
+int pool_threads = 0;
+
+// Tasks a participant has still to run. The owner takes from the front,
+// others steal the back half once they run out.
+struct pool_queue {
+  pthread_mutex_t lock;
+  long lo;
+  long hi;
+};
+
+// One call to pmap or preduce. Values cross between heaps packed as
+// images: every participant unpacks the function and its variables, packs
+// the elements of its tasks straight from the caller's list, which
+// nothing changes while the job runs, and packs each result.
+struct pool_job {
+  char* ctx;
+  size_t ctx_len;
+
+  lval* l;
+  long chunk;      // Elements folded by each task, one for pmap
+  int reduce;
+  long ntasks;
+
+  int vm;          // Settings of the caller's interpreter
+  int mpc;
+
+  char** out;
+  size_t* out_len;
+
+  struct pool_queue* queues;
+  int nqueues;
+
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  int running;     // Participants still working
+  long failed;     // First task that gave an error, ntasks if none
+};
+
+// Call started by spawn. The future value holds a reference, and so does
+// the queue until a worker takes the call from it. Whichever comes first,
+// a worker or an await, runs the call.
+struct lfuture {
+  int refs;
+  int state;
+
+  char* ctx;       // The function and its arguments, with their variables
+  size_t ctx_len;
+  int vm;
+  int mpc;
+
+  char* out;       // Packed result once done
+  size_t out_len;
+
+  struct lfuture* next;
+};
+
+enum { FUT_QUEUED, FUT_RUNNING, FUT_DONE };
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t finished; // Signalled as each spawned call finishes
+  int started;
+  int nworkers;
+  struct pool_job* job;    // Open to workers joining while set
+  long gen;                // Bumped for each job handed to the workers
+  int busy;                // Set while the workers have a job
+  struct lfuture* spawned; // Calls waiting for a worker, oldest first
+  struct lfuture* last;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+           0, 0, NULL, 0, 0, NULL, NULL };
+
+//Set while this thread is running tasks, jobs started from inside one
+//are run by the thread alone
+static __thread int pool_inside = 0;
+
+//Copy a value from another heap into this thread's
+static lval* pool_copy(lval* v) {
+  size_t len;
+  lval* err;
+  char* src = image_pack(NULL, v, &len, &err);
+  if (!src) { return err; }
+  lval* x = image_unpack(NULL, src, len);
+  free(src);
+  return x;
+}
+
+//Run task i, calling f on its element or folding its run of elements
+static lval* pool_task(struct pool_job* j, lenv* e, lval* f, long i) {
+  long lo = i * j->chunk;
+  long hi = lo + j->chunk < j->l->count ? lo + j->chunk : j->l->count;
+
+  lval* x = pool_copy(j->l->cell[lo]);
+  if (x->type == LVAL_ERR) { return x; }
+  if (!j->reduce) { return lval_call(e, f, lval_add(lval_sexpr(), x)); }
+
+  for (long k = lo+1; k < hi && x->type != LVAL_ERR; k++) {
+    lval* y = pool_copy(j->l->cell[k]);
+    if (y->type == LVAL_ERR) { lval_del(x); return y; }
+    x = lval_call(e, f, lval_add(lval_add(lval_sexpr(), x), y));
+  }
+  return x;
+}
+
+//Find the next task for participant me, stealing if its own are done
+static int pool_next(struct pool_job* j, int me, long* i) {
+  struct pool_queue* q = &j->queues[me];
+  pthread_mutex_lock(&q->lock);
+  int found = q->lo < q->hi;
+  if (found) { *i = q->lo++; }
+  pthread_mutex_unlock(&q->lock);
+  if (found) { return 1; }
+
+  for (int k = 1; k < j->nqueues; k++) {
+    struct pool_queue* v = &j->queues[(me + k) % j->nqueues];
+    pthread_mutex_lock(&v->lock);
+    long lo = v->lo + (v->hi - v->lo) / 2;
+    long hi = v->hi;
+    if (lo < hi) { v->hi = lo; }
+    pthread_mutex_unlock(&v->lock);
+
+    if (lo < hi) {
+      pthread_mutex_lock(&q->lock);
+      q->lo = lo + 1;
+      q->hi = hi;
+      pthread_mutex_unlock(&q->lock);
+      *i = lo;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//Run tasks until there are none left anywhere. Tasks after one that
+//failed are skipped, those before it still run so the error returned is
+//always that of the first.
+static void pool_work(struct pool_job* j, int me) {
+  int inside = pool_inside;
+  int vm = vm_enabled;
+  int mpc = reader_use_mpc;
+  pool_inside = 1;
+  vm_enabled = j->vm;
+  reader_use_mpc = j->mpc;
+
+  lenv* e = lenv_new();
+  lval* f = image_unpack(e, j->ctx, j->ctx_len);
+
+  long i;
+  while (pool_next(j, me, &i)) {
+    pthread_mutex_lock(&j->lock);
+    int skip = i > j->failed;
+    pthread_mutex_unlock(&j->lock);
+    if (skip) { continue; }
+
+    lval* x = f->type == LVAL_ERR ? lval_copy(f) : pool_task(j, e, f, i);
+    lval* err = NULL;
+    j->out[i] = image_pack(NULL, x, &j->out_len[i], &err);
+    if (!j->out[i]) {
+      lval_del(x);
+      x = err;
+      j->out[i] = image_pack(NULL, x, &j->out_len[i], &err);
+    }
+
+    if (x->type == LVAL_ERR) {
+      pthread_mutex_lock(&j->lock);
+      if (i < j->failed) { j->failed = i; }
+      pthread_mutex_unlock(&j->lock);
+    }
+    lval_del(x);
+  }
+
+  lval_del(f);
+  lenv_del(e);
+  pool_inside = inside;
+  vm_enabled = vm;
+  reader_use_mpc = mpc;
+
+  pthread_mutex_lock(&j->lock);
+  if (--j->running == 0) { pthread_cond_signal(&j->done); }
+  pthread_mutex_unlock(&j->lock);
+}
+
+static void pool_future_run(struct lfuture* fut);
+
+//Workers join each job that is still open once they are free, and run
+//spawned calls in the order they were made when there is no job
+static void* pool_worker(void* arg) {
+  int me = (int)(long)arg;
+  long seen = 0;
+  pthread_mutex_lock(&pool.lock);
+  while (1) {
+    if (pool.gen != seen) {
+      seen = pool.gen;
+      struct pool_job* j = pool.job;
+      if (!j) { continue; }
+
+      pthread_mutex_lock(&j->lock);
+      j->running++;
+      pthread_mutex_unlock(&j->lock);
+      pthread_mutex_unlock(&pool.lock);
+      pool_work(j, me);
+      pthread_mutex_lock(&pool.lock);
+    } else if (pool.spawned) {
+      struct lfuture* fut = pool.spawned;
+      pool.spawned = fut->next;
+      if (!pool.spawned) { pool.last = NULL; }
+
+      //Calls already taken by an await are only dropped from the queue
+      int run = fut->state == FUT_QUEUED;
+      if (run) { fut->state = FUT_RUNNING; }
+      pthread_mutex_unlock(&pool.lock);
+      if (run) { pool_future_run(fut); }
+      pool_future_del(fut);
+      pthread_mutex_lock(&pool.lock);
+    } else {
+      pthread_cond_wait(&pool.wake, &pool.lock);
+    }
+  }
+  return NULL;
+}
+
+static void pool_start(void) {
+  long n = pool_threads > 0 ? pool_threads : sysconf(_SC_NPROCESSORS_ONLN);
+  for (long k = 1; k < n; k++) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, pool_worker, (void*)k) != 0) { break; }
+    pthread_detach(t);
+    pool.nworkers++;
+  }
+  pool.started = 1;
+}
+
+//Values and names already walked by pool_vars
+struct pool_seen {
+  void* p;
+  UT_hash_handle hh;
+};
+
+static int pool_seen(struct pool_seen** seen, void* p) {
+  struct pool_seen* s;
+  HASH_FIND_PTR(*seen, &p, s);
+  if (s) { return 1; }
+  s = malloc(sizeof(struct pool_seen));
+  s->p = p;
+  HASH_ADD_PTR(*seen, p, s);
+  return 0;
+}
+
+//Whether sym names one of the formals of f or a variable in its frame,
+//which the body refers to rather than anything visible from the caller
+static int pool_bound(lval* f, char* sym) {
+  if (!f) { return 0; }
+  for (int i = 0; i < f->formals->count; i++) {
+    if (f->formals->cell[i]->sym == sym) { return 1; }
+  }
+  for (int i = 0; f->env->slots && i < f->env->slots->count; i++) {
+    if (f->env->slots->cell[i]->sym == sym) { return 1; }
+  }
+  struct lvar* var;
+  HASH_FIND_PTR(f->env->vars, &sym, var);
+  return var != NULL;
+}
+
+//Bind in flat the variables visible from e that v can refer to. Their
+//values are walked in turn, so functions they call are found as well.
+//Symbols bound by fn are skipped when v is part of its body. Symbols in
+//data are only looked up for builtins, which cost nothing to copy, so
+//data that is evaluated can still call them. Futures can't be copied,
+//names bound to one are left unbound.
+static void pool_vars(lenv* e, lval* v, lval* fn, int data, lenv* flat, struct pool_seen** seen) {
+  switch (v->type) {
+    case LVAL_SYM: {
+      if (pool_bound(fn, v->sym)) { break; }
+      lval* x = lenv_get(e, v);
+      int use = x->type != LVAL_ERR && x->type != LVAL_FUT
+        && (!data || (x->type == LVAL_FUN && x->builtin));
+      if (use && !pool_seen(seen, v->sym)) {
+        lenv_put(flat, v, x);
+        pool_vars(e, x, NULL, 0, flat, seen);
+      }
+      lval_del(x);
+    } break;
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+      if (pool_seen(seen, v)) { break; }
+      for (int i = 0; i < v->count; i++) { pool_vars(e, v->cell[i], fn, data, flat, seen); }
+    break;
+
+    case LVAL_FUN:
+      if (v->builtin || pool_seen(seen, v)) { break; }
+      pool_vars(e, v->body, v, 0, flat, seen);
+      for (int i = 0; v->env->slots && i < v->env->slots->count; i++) {
+        if (v->env->vals[i]) { pool_vars(e, v->env->vals[i], NULL, 0, flat, seen); }
+      }
+      for (struct lvar* var = v->env->vars; var; var = var->hh.next) {
+        pool_vars(e, var->val, NULL, 0, flat, seen);
+      }
+    break;
+
+    case LVAL_MAP:
+      if (pool_seen(seen, v)) { break; }
+      for (struct lentry* en = v->map; en; en = en->hh.next) {
+        pool_vars(e, en->key, fn, data, flat, seen);
+        pool_vars(e, en->val, fn, data, flat, seen);
+      }
+    break;
+
+    default: break;
+  }
+}
+
+//Pack v with the variables it and the elements of l, if there is one,
+//can refer to. Both are data, only the bodies of functions in them are
+//searched for variables.
+static char* pool_context(lenv* e, lval* v, lval* l, size_t* len, lval** err) {
+  lenv* flat = lenv_new();
+  struct pool_seen* seen = NULL;
+  pool_vars(e, v, NULL, 1, flat, &seen);
+  if (l) { pool_vars(e, l, NULL, 1, flat, &seen); }
+
+  char* ctx = image_pack(flat, v, len, err);
+
+  struct pool_seen *s, *tmp;
+  HASH_ITER(hh, seen, s, tmp) { HASH_DEL(seen, s); free(s); }
+  lenv_del(flat);
+  return ctx;
+}
+
+static lval* pool_run(lenv* e, lval* f, lval* l, long chunk, int reduce) {
+  struct pool_job j;
+  memset(&j, 0, sizeof(j));
+
+  lval* err;
+  j.ctx = pool_context(e, f, l, &j.ctx_len, &err);
+  if (!j.ctx) { return err; }
+
+  j.l = l;
+  j.chunk = chunk;
+  j.reduce = reduce;
+  j.ntasks = (l->count + chunk - 1) / chunk;
+  j.failed = j.ntasks;
+  j.vm = vm_enabled;
+  j.mpc = reader_use_mpc;
+  j.out = calloc(j.ntasks, sizeof(char*));
+  j.out_len = calloc(j.ntasks, sizeof(size_t));
+  pthread_mutex_init(&j.lock, NULL);
+  pthread_cond_init(&j.done, NULL);
+
+  //The workers take one job at a time, one started meanwhile by another
+  //interpreter's thread is run by its caller alone
+  pthread_mutex_lock(&pool.lock);
+  if (!pool.started) { pool_start(); }
+  int workers = pool_inside || pool.busy ? 0 : pool.nworkers;
+  if (workers) { pool.busy = 1; }
+  pthread_mutex_unlock(&pool.lock);
+
+  //Tasks start out split evenly between the participants
+  j.nqueues = workers + 1;
+  j.running = 1;
+  j.queues = malloc(sizeof(struct pool_queue) * j.nqueues);
+  for (int k = 0; k < j.nqueues; k++) {
+    pthread_mutex_init(&j.queues[k].lock, NULL);
+    j.queues[k].lo = j.ntasks * k / j.nqueues;
+    j.queues[k].hi = j.ntasks * (k+1) / j.nqueues;
+  }
+
+  if (workers) {
+    pthread_mutex_lock(&pool.lock);
+    pool.job = &j;
+    pool.gen++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+  }
+  pool_work(&j, 0);
+
+  //Workers still busy with spawned calls are not waited for, their share
+  //of the tasks has been stolen by the others
+  if (workers) {
+    pthread_mutex_lock(&pool.lock);
+    pool.job = NULL;
+    pool.busy = 0;
+    pthread_mutex_unlock(&pool.lock);
+  }
+
+  pthread_mutex_lock(&j.lock);
+  while (j.running) { pthread_cond_wait(&j.done, &j.lock); }
+  pthread_mutex_unlock(&j.lock);
+
+  //Results are unpacked in order on the calling thread
+  lval* x;
+  if (j.failed < j.ntasks) {
+    x = image_unpack(NULL, j.out[j.failed], j.out_len[j.failed]);
+  } else {
+    x = lval_reserve(lval_qexpr(), j.ntasks);
+    for (long i = 0; i < j.ntasks; i++) {
+      x = lval_add(x, image_unpack(NULL, j.out[i], j.out_len[i]));
+    }
+  }
+
+  for (long i = 0; i < j.ntasks; i++) { free(j.out[i]); }
+  for (int k = 0; k < j.nqueues; k++) { pthread_mutex_destroy(&j.queues[k].lock); }
+  free(j.queues);
+  free(j.out);
+  free(j.out_len);
+  free(j.ctx);
+  pthread_mutex_destroy(&j.lock);
+  pthread_cond_destroy(&j.done);
+  return x;
+}
+
+lval* pool_map(lenv* e, lval* f, lval* l) {
+  if (l->count == 0) { return lval_qexpr(); }
+  return pool_run(e, f, l, 1, 0);
+}
+
+lval* pool_reduce(lenv* e, lval* f, lval* l) {
+  return pool_run(e, f, l, (l->count + POOL_CHUNKS - 1) / POOL_CHUNKS, 1);
+}
+
+struct lfuture* pool_future_copy(struct lfuture* fut) {
+  __atomic_add_fetch(&fut->refs, 1, __ATOMIC_RELAXED);
+  return fut;
+}
+
+void pool_future_del(struct lfuture* fut) {
+  if (__atomic_sub_fetch(&fut->refs, 1, __ATOMIC_ACQ_REL) > 0) { return; }
+  free(fut->ctx);
+  free(fut->out);
+  free(fut);
+}
+
+//Make the call packed in fut and pack its result, on whichever thread
+//got to it first
+static void pool_future_run(struct lfuture* fut) {
+  int vm = vm_enabled;
+  int mpc = reader_use_mpc;
+  vm_enabled = fut->vm;
+  reader_use_mpc = fut->mpc;
+
+  lenv* e = lenv_new();
+  lval* x = image_unpack(e, fut->ctx, fut->ctx_len);
+  if (x->type != LVAL_ERR) {
+    lval* f = lval_pop(x, 0);
+    x = lval_call(e, f, x);
+    lval_del(f);
+  }
+
+  lval* err = NULL;
+  char* out = image_pack(NULL, x, &fut->out_len, &err);
+  if (!out) {
+    lval_del(x);
+    x = err;
+    out = image_pack(NULL, x, &fut->out_len, &err);
+  }
+  lval_del(x);
+  lenv_del(e);
+  vm_enabled = vm;
+  reader_use_mpc = mpc;
+
+  pthread_mutex_lock(&pool.lock);
+  fut->out = out;
+  fut->state = FUT_DONE;
+  pthread_cond_broadcast(&pool.finished);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+lval* pool_spawn(lenv* e, lval* a) {
+  struct lfuture* fut = calloc(1, sizeof(struct lfuture));
+  lval* err;
+  fut->ctx = pool_context(e, a, NULL, &fut->ctx_len, &err);
+  if (!fut->ctx) {
+    free(fut);
+    return err;
+  }
+  fut->refs = 1;
+  fut->state = FUT_QUEUED;
+  fut->vm = vm_enabled;
+  fut->mpc = reader_use_mpc;
+
+  //Without workers every call is made by the first await
+  pthread_mutex_lock(&pool.lock);
+  if (!pool.started) { pool_start(); }
+  if (pool.nworkers) {
+    fut->refs++;
+    if (pool.last) { pool.last->next = fut; } else { pool.spawned = fut; }
+    pool.last = fut;
+    pthread_cond_signal(&pool.wake);
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  return lval_fut(fut);
+}
+
+lval* pool_await(struct lfuture* fut) {
+  //A call no worker has taken yet is made here rather than waited for
+  pthread_mutex_lock(&pool.lock);
+  int run = fut->state == FUT_QUEUED;
+  if (run) { fut->state = FUT_RUNNING; }
+  pthread_mutex_unlock(&pool.lock);
+  if (run) { pool_future_run(fut); }
+
+  pthread_mutex_lock(&pool.lock);
+  while (fut->state != FUT_DONE) { pthread_cond_wait(&pool.finished, &pool.lock); }
+  pthread_mutex_unlock(&pool.lock);
+
+  return image_unpack(NULL, fut->out, fut->out_len);
+}
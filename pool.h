@@ -0,0 +1,39 @@
+#include "lval.h"
+
+#ifndef POOL_H
+#define POOL_H
+
+// Threads running the tasks of pmap and preduce, counting the thread that
+// called them, and the calls started by spawn. Zero gives one per
+// processor. Workers are started on first use and each allocates from a
+// heap of its own.
+extern int pool_threads;
+
+// preduce splits its list into at most this many runs. The split depends
+// only on the length of the list, never on the number of threads, so the
+// result is the same on any machine.
+#define POOL_CHUNKS 256
+
+//Call f on each element of l across the pool. Returns a q-expression of
+//the results in the order of l, or the error of the first element that
+//gave one. The function sees the variables visible from e that it can
+//refer to, as copies; l is only read.
+lval* pool_map(lenv* e, lval* f, lval* l);
+
+//Fold consecutive runs of l with f across the pool, returning the result
+//of each run in order. l must not be empty.
+lval* pool_reduce(lenv* e, lval* f, lval* l);
+
+//Start calling the function at the head of a with the rest as arguments,
+//returning a future for the result. The call sees copies of the
+//variables visible from e that it can refer to, like pool_map.
+lval* pool_spawn(lenv* e, lval* a);
+
+//Wait for a spawned call to finish, returning a copy of its result in
+//this thread's heap. It can be awaited any number of times.
+lval* pool_await(struct lfuture* fut);
+
+struct lfuture* pool_future_copy(struct lfuture* fut);
+void pool_future_del(struct lfuture* fut);
+
+#endif
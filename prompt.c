@@ -13,42 +13,57 @@
 #include <readline/history.h>
 #endif
 
-#include "mpc.h"
 #include "lval.h"
 #include "builtin.h"
+#include "reader.h"
+#include "image.h"
+#include "gc.h"
+#include "pool.h"
+#include "interp.h"
 
 int main(int argc, char** argv) {
-  // Create parser
-  number  = mpc_new("number");
-  symbol  = mpc_new("symbol");
-  string  = mpc_new("string");
-  comment = mpc_new("comment");
-  sexpr   = mpc_new("sexpr");
-  qexpr   = mpc_new("qexpr");
-  expr    = mpc_new("expr");
-  blisp   = mpc_new("blisp");
-
-  mpca_lang(MPC_LANG_DEFAULT,
-    "                                                  \
-      number   : /-?[0-9]+/ ;                          \
-      symbol   : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&%^|]+/ ; \
-      string   : /\"(\\\\.|[^\"])*\"/ ;                \
-      comment  : /;[^\\r\\n]*/ ;                       \
-      sexpr    : '(' <expr>* ')' ;                     \
-      qexpr    : '{' <expr>* '}' ;                     \
-      expr     : <number>  | <symbol> | <string>       \
-               | <comment> | <sexpr> | <qexpr> ;       \
-      blisp    : /^/ <expr>* /$/ ;                     \
-    ",
-    number, symbol, string, comment, sexpr, qexpr, expr, blisp
-  );
+  //Handle option flags, remaining args are files
+  char* image = NULL;
+  char* dump_image = NULL;
+  int flags = 0;
+  int nfiles = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--vm") == 0) {
+      flags |= LINTERP_VM;
+    } else if (strcmp(argv[i], "--mpc") == 0) {
+      flags |= LINTERP_MPC;
+    } else if (strcmp(argv[i], "--gc") == 0) {
+      flags |= LINTERP_GC;
+    } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+      pool_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--image") == 0 && i+1 < argc) {
+      image = argv[++i];
+    } else if (strcmp(argv[i], "--dump-image") == 0 && i+1 < argc) {
+      dump_image = argv[++i];
+    } else {
+      argv[++nfiles] = argv[i];
+    }
+  }
+  argc = nfiles + 1;
 
-  // Build environment before running
-  lenv* env = lenv_new();
-  lenv_add_builtins(env);
+  // Build environment before running, an image adds everything
+  // defined when it was dumped to the builtins
+  linterp* in = linterp_new(flags);
+  linterp_enter(in);
+  lenv* env = in->env;
+  if (image) {
+    lval* x = image_load(env, image);
+    if (x->type == LVAL_ERR) {
+      lval_println(x);
+      lval_del(x);
+      linterp_del(in);
+      return 1;
+    }
+    lval_del(x);
+  }
 
   //Run interpreter
-  if (argc == 1) {
+  if (argc == 1 && !dump_image) {
     // Print version info
     puts("BLisp v0.0.1");
     puts("Press Ctrl+C to Exit");
@@ -56,25 +71,24 @@ int main(int argc, char** argv) {
     while (1) {
       char* input = readline("Blisp> ");
 
+      //Stop at end of input
+      if (input == NULL) break;
+
       //Skip input if blank
       if (strcmp(input, "") == 0) continue;
 
       add_history(input);
 
-      //Parse input
-      mpc_result_t r;
-      if (mpc_parse("<stdin>", input, blisp, &r)) {
-        lval* x = lval_eval(env, lval_read(r.output));
-        lval_println(x);
-        lval_del(x);
-        mpc_ast_delete(r.output);
-      } else {
-        //Failed, print parser error
-        mpc_err_print(r.error);
-        mpc_err_delete(r.error);
+      //Parse input, printing the error if it failed
+      lval* x = lval_read_src("<stdin>", input, strlen(input));
+      if (x->type != LVAL_ERR) {
+        x = lval_eval(env, x);
       }
+      lval_println(x);
+      lval_del(x);
 
       free(input);
+      gc_safepoint();
     }
   }
 
@@ -82,8 +96,7 @@ int main(int argc, char** argv) {
   if (argc >= 2) {
     //Loop over args, process contents, print any returned errors
     for (int i = 1; i < argc; i++) {
-      lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
-      lval* x = builtin_load(env, args);
+      lval* x = lval_load(env, argv[i], 1);
       if (x->type == LVAL_ERR) {
         lval_println(x);
       }
@@ -91,8 +104,17 @@ int main(int argc, char** argv) {
     }
   }
 
-  //Cleanup parser before exiting
-  mpc_cleanup(8, number, symbol, string, comment, sexpr, qexpr, expr, blisp);
-  lenv_del(env);
-  return 0;
+  //Save the environment the files built up
+  int status = 0;
+  if (dump_image) {
+    lval* x = image_dump(env, dump_image);
+    if (x->type == LVAL_ERR) {
+      lval_println(x);
+      status = 1;
+    }
+    lval_del(x);
+  }
+
+  linterp_del(in);
+  return status;
 }
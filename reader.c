@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "mpc.h"
+#include "lval.h"
+#include "big.h"
+#include "reader.h"
+
+__thread int reader_use_mpc = 0;
+
+// Position in the source being read
+struct lreader {
+  char* filename;
+  char* src;
+  char* end;
+  char* p;
+
+  // Scratch space strings are unescaped into
+  char* buf;
+  size_t buf_size;
+
+  // Expressions read for the lists still open, each list is sized
+  // once its length is known
+  lval** stack;
+  int top;
+  int stack_size;
+
+  lval* err;
+};
+
+static int is_symbol_char(char c) {
+  return isalnum((unsigned char)c) || (c != '\0' && strchr("_+-*/\\=<>!&%^|", c));
+}
+
+//Describe the character at p the way mpc does in its errors
+static char* describe(struct lreader* r, char* buf) {
+  if (r->p == r->end) { return "end of input"; }
+  switch (*r->p) {
+    case '\n': return "newline";
+    case '\t': return "tab";
+    case '\r': return "carriage return";
+    case ' ': return "space";
+  }
+  sprintf(buf, "'%c'", *r->p);
+  return buf;
+}
+
+//Record an error at the current position, row and column are only
+//worked out once something has gone wrong
+static lval* read_error(struct lreader* r, char* expected) {
+  int row = 1, col = 1;
+  for (char* c = r->src; c < r->p; c++) {
+    if (*c == '\n') { row++; col = 1; } else { col++; }
+  }
+
+  char buf[8];
+  r->err = lval_err("%s:%i:%i: error: expected %s at %s",
+      r->filename, row, col, expected, describe(r, buf));
+  return NULL;
+}
+
+//Skip whitespace and comments
+static void skip_space(struct lreader* r) {
+  while (r->p < r->end) {
+    if (isspace((unsigned char)*r->p)) {
+      r->p++;
+    } else if (*r->p == ';') {
+      while (r->p < r->end && *r->p != '\r' && *r->p != '\n') { r->p++; }
+    } else {
+      break;
+    }
+  }
+}
+
+//Find the end of a number with a fraction or exponent, as in the grammar.
+//NULL if the number at p is an integer.
+static char* float_end(struct lreader* r) {
+  char* p = r->p;
+  int frac = 0;
+  if (*p == '-') { p++; }
+  while (p < r->end && isdigit((unsigned char)*p)) { p++; }
+
+  if (p+1 < r->end && *p == '.' && isdigit((unsigned char)p[1])) {
+    frac = 1;
+    p++;
+    while (p < r->end && isdigit((unsigned char)*p)) { p++; }
+  }
+  if (p < r->end && (*p == 'e' || *p == 'E')) {
+    char* e = p + 1;
+    if (e < r->end && (*e == '-' || *e == '+')) { e++; }
+    if (e < r->end && isdigit((unsigned char)*e)) {
+      p = e;
+      while (p < r->end && isdigit((unsigned char)*p)) { p++; }
+      return p;
+    }
+  }
+  return frac ? p : NULL;
+}
+
+static lval* read_dbl(struct lreader* r, char* end) {
+  char* start = r->p;
+  r->p = end;
+
+  //The source need not be terminated, strtod is given a copy
+  size_t len = r->p - start;
+  if (len + 1 > r->buf_size) {
+    r->buf_size = len + 1 > 64 ? len + 1 : 64;
+    r->buf = realloc(r->buf, r->buf_size);
+  }
+  memcpy(r->buf, start, len);
+  r->buf[len] = '\0';
+
+  errno = 0;
+  double x = strtod(r->buf, NULL);
+  if (errno == ERANGE && fabs(x) == HUGE_VAL) { return lval_err("Invalid number"); }
+  return lval_dbl(x);
+}
+
+static lval* read_num(struct lreader* r) {
+  char* start = r->p;
+  char* end = float_end(r);
+  if (end) { return read_dbl(r, end); }
+
+  int neg = *r->p == '-';
+  if (neg) { r->p++; }
+
+  //Accumulate as unsigned so the most negative long can be read
+  unsigned long limit = neg ? (unsigned long)LONG_MAX + 1 : LONG_MAX;
+  unsigned long x = 0;
+  int range = 0;
+  while (r->p < r->end && isdigit((unsigned char)*r->p)) {
+    int d = *r->p++ - '0';
+    if (x > (limit - d) / 10) { range = 1; }
+    if (!range) { x = x * 10 + d; }
+  }
+
+  //Numbers too large for a long are read again as bignums
+  if (range) { return lval_big(big_from_dec(start, r->p - start)); }
+  return lval_num(neg ? (long)(0 - x) : (long)x);
+}
+
+static lval* read_sym(struct lreader* r) {
+  char* start = r->p;
+  while (r->p < r->end && is_symbol_char(*r->p)) { r->p++; }
+  return lval_sym_len(start, r->p - start);
+}
+
+//Escapes understood in strings, as mpcf_unescape
+static char* escape_in = "abfnrtv\\'\"0";
+static char* escape_out = "\a\b\f\n\r\t\v\\'\"";
+
+static lval* read_str(struct lreader* r) {
+  size_t len = 0;
+  r->p++;
+
+  while (1) {
+    if (r->p == r->end) { return read_error(r, "'\"'"); }
+    if (*r->p == '"') { r->p++; break; }
+
+    //Escapes take at most two characters, grow scratch space ahead
+    if (len + 2 >= r->buf_size) {
+      r->buf_size = r->buf_size ? r->buf_size * 2 : 64;
+      r->buf = realloc(r->buf, r->buf_size);
+    }
+
+    char c = *r->p++;
+    if (c == '\\' && r->p < r->end) {
+      char* e = strchr(escape_in, *r->p);
+      if (e && *e) {
+        r->buf[len++] = *e == '0' ? '\0' : escape_out[e - escape_in];
+        r->p++;
+        continue;
+      }
+    }
+    r->buf[len++] = c;
+  }
+
+  r->buf[len] = '\0';
+  return lval_str(r->buf);
+}
+
+static lval* read_expr(struct lreader* r);
+
+//Read expressions into x until the closing bracket
+static lval* read_list(struct lreader* r, lval* x, char close) {
+  char expected[32];
+  sprintf(expected, "expression or '%c'", close);
+  r->p++;
+
+  int base = r->top;
+  while (1) {
+    skip_space(r);
+    if (r->p < r->end && *r->p == close) {
+      r->p++;
+      break;
+    }
+
+    lval* y = read_expr(r);
+    if (y == NULL) {
+      if (!r->err) { read_error(r, expected); }
+      while (r->top > base) { lval_del(r->stack[--r->top]); }
+      lval_del(x);
+      return NULL;
+    }
+
+    if (r->top == r->stack_size) {
+      r->stack_size = r->stack_size ? r->stack_size * 2 : 64;
+      r->stack = realloc(r->stack, sizeof(lval*) * r->stack_size);
+    }
+    r->stack[r->top++] = y;
+  }
+
+  //Move the children into x in one allocation
+  if (r->top > base) {
+    x = lval_resize(x, r->top - base);
+    memcpy(x->cell, &r->stack[base], sizeof(lval*) * x->count);
+    r->top = base;
+  }
+  return x;
+}
+
+//Read one expression, NULL if there is none at the current position
+static lval* read_expr(struct lreader* r) {
+  if (r->p == r->end) { return NULL; }
+
+  char c = *r->p;
+  if (c == '(') { return read_list(r, lval_sexpr(), ')'); }
+  if (c == '{') { return read_list(r, lval_qexpr(), '}'); }
+  if (c == '"') { return read_str(r); }
+
+  //Numbers are tried before symbols, as in the grammar
+  if (isdigit((unsigned char)c)
+      || (c == '-' && r->p+1 < r->end && isdigit((unsigned char)r->p[1]))) {
+    return read_num(r);
+  }
+  if (is_symbol_char(c)) { return read_sym(r); }
+
+  return NULL;
+}
+
+//The mpc grammar is built on first use and shared by every interpreter,
+//parsing only reads it
+static mpc_parser_t* blisp;
+static pthread_once_t grammar_once = PTHREAD_ONCE_INIT;
+
+static void read_grammar(void) {
+  mpc_parser_t* number  = mpc_new("number");
+  mpc_parser_t* symbol  = mpc_new("symbol");
+  mpc_parser_t* string  = mpc_new("string");
+  mpc_parser_t* comment = mpc_new("comment");
+  mpc_parser_t* sexpr   = mpc_new("sexpr");
+  mpc_parser_t* qexpr   = mpc_new("qexpr");
+  mpc_parser_t* expr    = mpc_new("expr");
+  blisp = mpc_new("blisp");
+
+  mpca_lang(MPC_LANG_DEFAULT,
+    "                                                       \
+      number   : /-?[0-9]+(\\.[0-9]+)?([eE][-+]?[0-9]+)?/ ; \
+      symbol   : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&%^|]+/ ;      \
+      string   : /\"(\\\\.|[^\"])*\"/ ;                     \
+      comment  : /;[^\\r\\n]*/ ;                            \
+      sexpr    : '(' <expr>* ')' ;                          \
+      qexpr    : '{' <expr>* '}' ;                          \
+      expr     : <number>  | <symbol> | <string>            \
+               | <comment> | <sexpr> | <qexpr> ;            \
+      blisp    : /^/ <expr>* /$/ ;                          \
+    ",
+    number, symbol, string, comment, sexpr, qexpr, expr, blisp
+  );
+}
+
+//Read a file or string through the mpc grammar
+static lval* read_mpc(char* filename, char* src) {
+  pthread_once(&grammar_once, read_grammar);
+
+  mpc_result_t res;
+  int ok = src ? mpc_parse(filename, src, blisp, &res)
+               : mpc_parse_contents(filename, blisp, &res);
+
+  if (ok) {
+    lval* x = lval_read(res.output);
+    mpc_ast_delete(res.output);
+    return x;
+  }
+
+  char* msg = mpc_err_string(res.error);
+  mpc_err_delete(res.error);
+
+  //Drop the trailing newline from the message
+  size_t len = strlen(msg);
+  if (len && msg[len-1] == '\n') { msg[len-1] = '\0'; }
+  lval* err = lval_err("%s", msg);
+  free(msg);
+  return err;
+}
+
+lval* lval_read_src(char* filename, char* src, size_t len) {
+  if (reader_use_mpc) { return read_mpc(filename, src); }
+
+  struct lreader r;
+  r.filename = filename;
+  r.src = src;
+  r.end = src + len;
+  r.p = src;
+  r.buf = NULL;
+  r.buf_size = 0;
+  r.stack = NULL;
+  r.top = 0;
+  r.stack_size = 0;
+  r.err = NULL;
+
+  lval* x = lval_sexpr();
+  while (1) {
+    skip_space(&r);
+    if (r.p == r.end) { break; }
+
+    lval* y = read_expr(&r);
+    if (y == NULL) {
+      if (!r.err) { read_error(&r, "expression or end of input"); }
+      lval_del(x);
+      x = r.err;
+      break;
+    }
+    x = lval_add(x, y);
+  }
+
+  free(r.buf);
+  free(r.stack);
+  return x;
+}
+
+lval* lval_read_file(char* filename) {
+  if (reader_use_mpc) { return read_mpc(filename, NULL); }
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return lval_err("%s: error: Unable to open file!", filename); }
+
+  //Regular files are mapped and read in place
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    char* src = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (src != MAP_FAILED) {
+      close(fd);
+      lval* x = lval_read_src(filename, src, st.st_size);
+      munmap(src, st.st_size);
+      return x;
+    }
+  }
+
+  //Anything else is read into memory until end of file
+  size_t len = 0;
+  size_t size = 4096;
+  char* src = malloc(size);
+  ssize_t n;
+  while ((n = read(fd, src + len, size - len)) > 0) {
+    len += n;
+    if (len == size) {
+      size *= 2;
+      src = realloc(src, size);
+    }
+  }
+  close(fd);
+
+  lval* x = lval_read_src(filename, src, len);
+  free(src);
+  return x;
+}
@@ -0,0 +1,15 @@
+#include "lval.h"
+
+#ifndef READER_H
+#define READER_H
+
+// Set to read source through the mpc grammar instead of the reader, for
+// the interpreter a thread has entered
+extern __thread int reader_use_mpc;
+
+//Read every expression in src into an s-expression. Errors are returned
+//as an lval error giving the position reading stopped at.
+lval* lval_read_src(char* filename, char* src, size_t len);
+lval* lval_read_file(char* filename);
+
+#endif
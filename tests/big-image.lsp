@@ -0,0 +1,6 @@
+; Run on the image tests/big.lsp dumps, the bignums it defined load back
+; unchanged wherever they are held
+(print (== a (^ 3 500)) (== b (^ 7 300)) (== c (^ 3 700)) (== d (^ 7 420)))
+(print (% e m) n (- 0 n))
+(print l (eval (tail (tail l))))
+(print (scale 1) (scale -3))
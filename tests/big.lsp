@@ -0,0 +1,45 @@
+; Integers past 64 bits become bignums. Products of operands with at least
+; BIG_KARATSUBA (32) limbs are split, smaller ones use the plain loop.
+(def {m} 1000000007)
+
+; Below the threshold, 25 and 27 limbs
+(def {a} (^ 3 500))
+(def {b} (^ 7 300))
+(print (* a b))
+(print (== (/ (* a b) b) a) (% (* a b) b))
+
+; Above it, 35 and 37 limbs
+(def {c} (^ 3 700))
+(def {d} (^ 7 420))
+(print (* c d))
+(print (== (/ (* c d) d) c) (% (* c d) d))
+
+; Several levels of splitting, and operands of very different sizes
+(def {e} (* (^ 3 5000) (^ 7 3000)))
+(print (% e m) (== e (* (^ 21 3000) (^ 3 2000))))
+(print (% (* (^ 3 5000) (^ 7 40)) m) (% (* (^ 7 40) (^ 3 5000)) m))
+
+; Division truncates toward zero, the remainder has the sign of the dividend
+(def {n} (+ (^ 10 30) 7))
+(print (/ n 9) (% n 9))
+(print (/ (- 0 n) 9) (% (- 0 n) 9))
+(print (/ n -9) (% n -9))
+(print (/ (- 0 n) -9) (% (- 0 n) -9))
+(print (/ -7 2) (% -7 2) (/ 7 -2) (% 7 -2))
+
+; The one long division that overflows
+(print (/ -9223372036854775808 -1) (% -9223372036854775808 -1))
+(print (* -9223372036854775808 -1) (- 0 -9223372036854775808))
+
+; Literals read past 64 bits and print back unchanged
+(print 9223372036854775807 9223372036854775808 -9223372036854775808 -9223372036854775809)
+(print 18446744073709551616 -340282366920938463463374607431768211456)
+(print (- 18446744073709551616 1) (+ 9223372036854775807 1))
+
+; Mixed with floats the result is a float
+(print (+ (^ 2 70) 0.5) (* 1.5 (^ 2 70)) (/ (^ 2 70) 4.0))
+(print (< (^ 10 20) 1e21) (> (^ 10 20) 1e19) (== (^ 2 64) 18446744073709551616.0))
+
+; Kept for tests/big-image.lsp, which runs on an image of this file
+(def {l} {18446744073709551616 -9223372036854775809 (^ 2 100)})
+(def {scale} (\ {x} {* x 340282366920938463463374607431768211456}))
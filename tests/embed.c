@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include "../blisp.h"
+
+static int failed = 0;
+
+static void expect(int ok, const char* what) {
+  if (!ok) {
+    printf("FAIL %s\n", what);
+    failed = 1;
+  }
+}
+
+static long eval_long(blisp_interp* b, const char* src) {
+  long n = -1;
+  blisp_value* v = blisp_eval_string(b, src);
+  blisp_to_long(v, &n);
+  blisp_free(b, v);
+  return n;
+}
+
+int main(void) {
+  blisp_interp* b = blisp_new(0);
+
+  //Appending to a value taken from a variable leaves the variable alone
+  blisp_free(b, blisp_eval_string(b, "(def {x} {1 2})"));
+  blisp_value* x = blisp_eval_string(b, "x");
+  x = blisp_append(b, x, blisp_int(b, 3));
+  expect(blisp_count(x) == 3, "appended list has 3 items");
+  expect(eval_long(b, "(len x)") == 2, "x still has 2 items");
+  blisp_free(b, x);
+
+  //A list built up from nothing can be bound and read back
+  blisp_value* l = blisp_list(b);
+  for (int i = 0; i < 4; i++) { l = blisp_append(b, l, blisp_int(b, i)); }
+  blisp_define(b, "l", l);
+  expect(eval_long(b, "(foldl + 0 l)") == 6, "sum of l");
+
+  blisp_del(b);
+
+  //Values the caller holds survive collections between expressions
+  blisp_interp* g = blisp_new(BLISP_GC);
+  blisp_value* h = blisp_eval_string(g, "{1 2 3}");
+  blisp_free(g, blisp_eval_string(g,
+    "(def {count} (\\ {n} {if (== n 0) {0} {+ 1 (count (- n 1))}}))"
+    "(count 20000) (count 20000) (count 20000) (count 20000)"));
+  expect(eval_long(g, "(eval (head (gc-stats ())))") > 0, "collected between expressions");
+  expect(blisp_count(h) == 3, "held list intact");
+  blisp_free(g, h);
+  blisp_del(g);
+
+  return failed;
+}
@@ -0,0 +1,15 @@
+(def {fib} (\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}}))
+(print (await (spawn fib 15)) (await-all (map (\ {n} {spawn fib n}) {1 2 3 10})))
+(print (await-all (list (spawn + 1) (spawn / 1 0) (spawn head {}))))
+
+; A global future shares its name with formals, which refer to the
+; arguments and not the future
+(def {x} (spawn (\ {a} {a}) 1))
+(print (pmap (\ {x} {* x 2}) {1 2 3}))
+(print (await (spawn (\ {x} {* x 2}) 5)))
+(print (preduce (\ {x y} {+ x y}) 0 {1 2 3 4}))
+
+; Futures are left unbound rather than failing the whole call
+(print (await (spawn (\ {a} {+ a 1}) 1)) (await x))
+(print (pmap (\ {a} {x}) {1}))
+(print (await (spawn (\ {} {x}))))
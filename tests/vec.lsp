@@ -0,0 +1,19 @@
+; vec-min and vec-max give NaN when any element is one, whichever kernels
+; are in use. NaN is the only value not equal to itself.
+(def {nan} (sqrt -1))
+(def {isnan} (\ {x} {! (== x x)}))
+(def {at} (\ {i n} {vec (map (\ {k} {if (== k i) {nan} {(+ k 0.5)}}) (vec-list (vec-range n)))}))
+
+(def {check} (\ {i n} {
+  print i n (isnan (vec-min (at i n))) (isnan (vec-max (at i n)))}))
+
+(check 0 9)
+(check 1 9)
+(check 5 9)
+(check 7 9)
+(check 8 9)
+(check 2 3)
+(check 40 64)
+(check -1 9)
+(print (vec-min (at -1 9)) (vec-max (at -1 9)))
+(print (vec-min (vec {3.0 -1.5 2.0 7.25 0.0 4.0 -8.5 1.0 9.0})) (vec-max (vec {3.0 -1.5 2.0 7.25 0.0 4.0 -8.5 1.0 9.0})))
@@ -0,0 +1,359 @@
+#include <stddef.h>
+#include <math.h>
+#include "vec.h"
+
+#if !defined(VEC_SCALAR) && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VEC_AVX2
+#include <immintrin.h>
+#endif
+
+// Kernels chosen for this processor
+struct vec_kernels {
+  double (*sum_dbl)(double* a, long n);
+  int (*sum_int)(int64_t* a, long n, int64_t* r);
+  double (*dot_dbl)(double* a, double* b, long n);
+  void (*add_dbl)(double* r, double* a, double* b, long n);
+  int (*add_int)(int64_t* r, int64_t* a, int64_t* b, long n);
+  void (*mul_dbl)(double* r, double* a, double* b, long n);
+  void (*scale_dbl)(double* r, double* a, double k, long n);
+  double (*min_dbl)(double* a, long n);
+  double (*max_dbl)(double* a, long n);
+  int64_t (*min_int)(int64_t* a, long n);
+  int64_t (*max_int)(int64_t* a, long n);
+};
+
+//Plain loops, used where there is no faster kernel
+
+static double sum_dbl_scalar(double* a, long n) {
+  double s = 0;
+  for (long i = 0; i < n; i++) { s += a[i]; }
+  return s;
+}
+
+static int sum_int_scalar(int64_t* a, long n, int64_t* r) {
+  int64_t s = 0;
+  for (long i = 0; i < n; i++) {
+    if (__builtin_add_overflow(s, a[i], &s)) { return 0; }
+  }
+  *r = s;
+  return 1;
+}
+
+static double dot_dbl_scalar(double* a, double* b, long n) {
+  double s = 0;
+  for (long i = 0; i < n; i++) { s += a[i] * b[i]; }
+  return s;
+}
+
+static void add_dbl_scalar(double* r, double* a, double* b, long n) {
+  for (long i = 0; i < n; i++) { r[i] = a[i] + b[i]; }
+}
+
+static int add_int_scalar(int64_t* r, int64_t* a, int64_t* b, long n) {
+  for (long i = 0; i < n; i++) {
+    if (__builtin_add_overflow(a[i], b[i], &r[i])) { return 0; }
+  }
+  return 1;
+}
+
+static void mul_dbl_scalar(double* r, double* a, double* b, long n) {
+  for (long i = 0; i < n; i++) { r[i] = a[i] * b[i]; }
+}
+
+static void scale_dbl_scalar(double* r, double* a, double k, long n) {
+  for (long i = 0; i < n; i++) { r[i] = a[i] * k; }
+}
+
+//The first NaN in a is the minimum or maximum, otherwise comparisons
+//with it would make the result depend on where it is
+static double min_dbl_scalar(double* a, long n) {
+  double m = a[0];
+  for (long i = 1; i < n && !isnan(m); i++) {
+    if (a[i] < m || isnan(a[i])) { m = a[i]; }
+  }
+  return m;
+}
+
+static double max_dbl_scalar(double* a, long n) {
+  double m = a[0];
+  for (long i = 1; i < n && !isnan(m); i++) {
+    if (a[i] > m || isnan(a[i])) { m = a[i]; }
+  }
+  return m;
+}
+
+static int64_t min_int_scalar(int64_t* a, long n) {
+  int64_t m = a[0];
+  for (long i = 1; i < n; i++) { if (a[i] < m) { m = a[i]; } }
+  return m;
+}
+
+static int64_t max_int_scalar(int64_t* a, long n) {
+  int64_t m = a[0];
+  for (long i = 1; i < n; i++) { if (a[i] > m) { m = a[i]; } }
+  return m;
+}
+
+static struct vec_kernels scalar_kernels = {
+  sum_dbl_scalar, sum_int_scalar, dot_dbl_scalar,
+  add_dbl_scalar, add_int_scalar, mul_dbl_scalar, scale_dbl_scalar,
+  min_dbl_scalar, max_dbl_scalar, min_int_scalar, max_int_scalar
+};
+
+#ifdef VEC_AVX2
+
+//AVX2 kernels take four lanes at a time and finish any remainder with the
+//plain loop. Loads are unaligned, arrays come straight from malloc.
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static double hsum_pd(__m256d v) {
+  __m128d lo = _mm256_castpd256_pd128(v);
+  __m128d hi = _mm256_extractf128_pd(v, 1);
+  lo = _mm_add_pd(lo, hi);
+  return _mm_cvtsd_f64(lo) + _mm_cvtsd_f64(_mm_unpackhi_pd(lo, lo));
+}
+
+AVX2 static double sum_dbl_avx2(double* a, long n) {
+  //Two accumulators hide the latency of the adds
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+    s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+  }
+  for (; i + 4 <= n; i += 4) { s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i)); }
+  return hsum_pd(_mm256_add_pd(s0, s1)) + sum_dbl_scalar(a + i, n - i);
+}
+
+//A lane overflowed if the sum's sign differs from both operands'
+AVX2 static __m256i add_overflow(__m256i x, __m256i y, __m256i s) {
+  return _mm256_and_si256(_mm256_xor_si256(x, s), _mm256_xor_si256(y, s));
+}
+
+//Lane sums are exact if no lane overflowed, the final sum is then checked
+//as it is combined. A lane overflowing on the way to a total that fits
+//is reported too, callers fall back to exact arithmetic.
+AVX2 static int sum_int_avx2(int64_t* a, long n, int64_t* r) {
+  __m256i s = _mm256_setzero_si256(), ov = _mm256_setzero_si256();
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i*)(a + i));
+    __m256i t = _mm256_add_epi64(s, x);
+    ov = _mm256_or_si256(ov, add_overflow(s, x, t));
+    s = t;
+  }
+  if (_mm256_movemask_pd(_mm256_castsi256_pd(ov))) { return 0; }
+
+  int64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, s);
+  int64_t tail;
+  if (!sum_int_scalar(a + i, n - i, &tail)) { return 0; }
+  for (int k = 0; k < 4; k++) {
+    if (__builtin_add_overflow(tail, lanes[k], &tail)) { return 0; }
+  }
+  *r = tail;
+  return 1;
+}
+
+AVX2 static double dot_dbl_avx2(double* a, double* b, long n) {
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+  }
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+  return hsum_pd(_mm256_add_pd(s0, s1)) + dot_dbl_scalar(a + i, b + i, n - i);
+}
+
+AVX2 static void add_dbl_avx2(double* r, double* a, double* b, long n) {
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(r + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+  add_dbl_scalar(r + i, a + i, b + i, n - i);
+}
+
+AVX2 static int add_int_avx2(int64_t* r, int64_t* a, int64_t* b, long n) {
+  __m256i ov = _mm256_setzero_si256();
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((__m256i*)(b + i));
+    __m256i s = _mm256_add_epi64(x, y);
+    ov = _mm256_or_si256(ov, add_overflow(x, y, s));
+    _mm256_storeu_si256((__m256i*)(r + i), s);
+  }
+  if (_mm256_movemask_pd(_mm256_castsi256_pd(ov))) { return 0; }
+  return add_int_scalar(r + i, a + i, b + i, n - i);
+}
+
+AVX2 static void mul_dbl_avx2(double* r, double* a, double* b, long n) {
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(r + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+  }
+  mul_dbl_scalar(r + i, a + i, b + i, n - i);
+}
+
+AVX2 static void scale_dbl_avx2(double* r, double* a, double k, long n) {
+  __m256d kv = _mm256_set1_pd(k);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(r + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), kv));
+  }
+  scale_dbl_scalar(r + i, a + i, k, n - i);
+}
+
+//_mm256_min_pd passes over NaNs in one operand, so lanes holding any are
+//tracked separately and the plain loop finds the first
+AVX2 static double min_dbl_avx2(double* a, long n) {
+  if (n < 4) { return min_dbl_scalar(a, n); }
+  __m256d m = _mm256_loadu_pd(a);
+  __m256d nan = _mm256_cmp_pd(m, m, _CMP_UNORD_Q);
+  long i = 4;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i);
+    nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+    m = _mm256_min_pd(m, x);
+  }
+  if (_mm256_movemask_pd(nan)) { return min_dbl_scalar(a, i); }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, m);
+  double x = min_dbl_scalar(lanes, 4);
+  if (i < n) {
+    double t = min_dbl_scalar(a + i, n - i);
+    if (t < x || isnan(t)) { x = t; }
+  }
+  return x;
+}
+
+AVX2 static double max_dbl_avx2(double* a, long n) {
+  if (n < 4) { return max_dbl_scalar(a, n); }
+  __m256d m = _mm256_loadu_pd(a);
+  __m256d nan = _mm256_cmp_pd(m, m, _CMP_UNORD_Q);
+  long i = 4;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = _mm256_loadu_pd(a + i);
+    nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+    m = _mm256_max_pd(m, x);
+  }
+  if (_mm256_movemask_pd(nan)) { return max_dbl_scalar(a, i); }
+
+  double lanes[4];
+  _mm256_storeu_pd(lanes, m);
+  double x = max_dbl_scalar(lanes, 4);
+  if (i < n) {
+    double t = max_dbl_scalar(a + i, n - i);
+    if (t > x || isnan(t)) { x = t; }
+  }
+  return x;
+}
+
+//There is no 64 bit integer min or max before AVX-512, lanes are
+//compared and blended instead
+AVX2 static int64_t min_int_avx2(int64_t* a, long n) {
+  if (n < 4) { return min_int_scalar(a, n); }
+  __m256i m = _mm256_loadu_si256((__m256i*)a);
+  long i = 4;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i*)(a + i));
+    m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(m, x));
+  }
+
+  int64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, m);
+  int64_t x = min_int_scalar(lanes, 4);
+  if (i < n) {
+    int64_t t = min_int_scalar(a + i, n - i);
+    if (t < x) { x = t; }
+  }
+  return x;
+}
+
+AVX2 static int64_t max_int_avx2(int64_t* a, long n) {
+  if (n < 4) { return max_int_scalar(a, n); }
+  __m256i m = _mm256_loadu_si256((__m256i*)a);
+  long i = 4;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i*)(a + i));
+    m = _mm256_blendv_epi8(m, x, _mm256_cmpgt_epi64(x, m));
+  }
+
+  int64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, m);
+  int64_t x = max_int_scalar(lanes, 4);
+  if (i < n) {
+    int64_t t = max_int_scalar(a + i, n - i);
+    if (t > x) { x = t; }
+  }
+  return x;
+}
+
+static struct vec_kernels avx2_kernels = {
+  sum_dbl_avx2, sum_int_avx2, dot_dbl_avx2,
+  add_dbl_avx2, add_int_avx2, mul_dbl_avx2, scale_dbl_avx2,
+  min_dbl_avx2, max_dbl_avx2, min_int_avx2, max_int_avx2
+};
+
+#endif
+
+static struct vec_kernels* kernels = NULL;
+
+//Threads may race to pick the kernels, they all pick the same ones
+static struct vec_kernels* vec_kernels(void) {
+  struct vec_kernels* k = __atomic_load_n(&kernels, __ATOMIC_ACQUIRE);
+  if (!k) {
+    k = &scalar_kernels;
+#ifdef VEC_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { k = &avx2_kernels; }
+#endif
+    __atomic_store_n(&kernels, k, __ATOMIC_RELEASE);
+  }
+  return k;
+}
+
+double vec_sum_dbl(double* a, long n) { return vec_kernels()->sum_dbl(a, n); }
+int vec_sum_int(int64_t* a, long n, int64_t* r) { return vec_kernels()->sum_int(a, n, r); }
+double vec_dot_dbl(double* a, double* b, long n) { return vec_kernels()->dot_dbl(a, b, n); }
+
+void vec_add_dbl(double* r, double* a, double* b, long n) { vec_kernels()->add_dbl(r, a, b, n); }
+int vec_add_int(int64_t* r, int64_t* a, int64_t* b, long n) { return vec_kernels()->add_int(r, a, b, n); }
+void vec_mul_dbl(double* r, double* a, double* b, long n) { vec_kernels()->mul_dbl(r, a, b, n); }
+void vec_scale_dbl(double* r, double* a, double k, long n) { vec_kernels()->scale_dbl(r, a, k, n); }
+
+double vec_min_dbl(double* a, long n) { return vec_kernels()->min_dbl(a, n); }
+double vec_max_dbl(double* a, long n) { return vec_kernels()->max_dbl(a, n); }
+int64_t vec_min_int(int64_t* a, long n) { return vec_kernels()->min_int(a, n); }
+int64_t vec_max_int(int64_t* a, long n) { return vec_kernels()->max_int(a, n); }
+
+//AVX2 has no 64 bit multiply, these are plain loops everywhere
+
+int vec_dot_int(int64_t* a, int64_t* b, long n, int64_t* r) {
+  int64_t s = 0, p;
+  for (long i = 0; i < n; i++) {
+    if (__builtin_mul_overflow(a[i], b[i], &p)) { return 0; }
+    if (__builtin_add_overflow(s, p, &s)) { return 0; }
+  }
+  *r = s;
+  return 1;
+}
+
+int vec_mul_int(int64_t* r, int64_t* a, int64_t* b, long n) {
+  for (long i = 0; i < n; i++) {
+    if (__builtin_mul_overflow(a[i], b[i], &r[i])) { return 0; }
+  }
+  return 1;
+}
+
+int vec_scale_int(int64_t* r, int64_t* a, int64_t k, long n) {
+  for (long i = 0; i < n; i++) {
+    if (__builtin_mul_overflow(a[i], k, &r[i])) { return 0; }
+  }
+  return 1;
+}
@@ -0,0 +1,33 @@
+#include <stdint.h>
+
+#ifndef VEC_H
+#define VEC_H
+
+// Kernels over unboxed arrays of numbers. On x86 the AVX2 versions are
+// used if the processor has them, checked once on first use, otherwise
+// plain loops. Build with -DVEC_SCALAR to always use the plain loops.
+//
+// Integer kernels that can overflow return 0 if they did, the result is
+// then not meaningful. Sums of doubles may be added in a different order
+// depending on the kernel, so the last bits can differ between machines.
+
+double vec_sum_dbl(double* a, long n);
+int vec_sum_int(int64_t* a, long n, int64_t* r);
+
+double vec_dot_dbl(double* a, double* b, long n);
+int vec_dot_int(int64_t* a, int64_t* b, long n, int64_t* r);
+
+void vec_add_dbl(double* r, double* a, double* b, long n);
+int vec_add_int(int64_t* r, int64_t* a, int64_t* b, long n);
+void vec_mul_dbl(double* r, double* a, double* b, long n);
+int vec_mul_int(int64_t* r, int64_t* a, int64_t* b, long n);
+void vec_scale_dbl(double* r, double* a, double k, long n);
+int vec_scale_int(int64_t* r, int64_t* a, int64_t k, long n);
+
+//n must be at least 1
+double vec_min_dbl(double* a, long n);
+double vec_max_dbl(double* a, long n);
+int64_t vec_min_int(int64_t* a, long n);
+int64_t vec_max_int(int64_t* a, long n);
+
+#endif
@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lval.h"
+#include "builtin.h"
+#include "vm.h"
+
+__thread int vm_enabled = 0;
+
+// Activation record for a lambda running on the vm
+struct vm_frame {
+  lcode* code;
+  int ip;
+  lenv* env;
+  lval* fn;
+};
+
+static lcode* lcode_new(void) {
+  lcode* c = malloc(sizeof(lcode));
+  c->refs = 1;
+  c->count = 0;
+  c->code = NULL;
+  c->nconsts = 0;
+  c->consts = NULL;
+  return c;
+}
+
+//Append a word to the code array and return its position
+static int emit(lcode* c, int word) {
+  c->count++;
+  c->code = realloc(c->code, sizeof(int) * c->count);
+  c->code[c->count-1] = word;
+  return c->count-1;
+}
+
+//Store a reference to v in the constant pool and return its index
+static int add_const(lcode* c, lval* v) {
+  c->nconsts++;
+  c->consts = realloc(c->consts, sizeof(lval*) * c->nconsts);
+  c->consts[c->nconsts-1] = lval_copy(v);
+  return c->nconsts-1;
+}
+
+//Check for (if cond {then} {else}) which can be compiled to jumps
+static int is_if(lval* v) {
+  return v->count == 4
+    && v->cell[0]->type == LVAL_SYM && strcmp(v->cell[0]->sym, "if") == 0
+    && v->cell[2]->type == LVAL_QEXPR && v->cell[3]->type == LVAL_QEXPR;
+}
+
+static void compile_expr(lcode* c, lval* v, lval* slots);
+static void compile_if(lcode* c, lval* v, lval* slots, int tail);
+
+//Compile the children of v evaluated as an s-expression. A call in tail
+//position replaces the running frame instead of pushing a new one.
+static void compile_sexpr(lcode* c, lval* v, lval* slots, int tail) {
+  if (is_if(v)) { compile_if(c, v, slots, tail); return; }
+
+  for (int i = 0; i < v->count; i++) {
+    compile_expr(c, v->cell[i], slots);
+  }
+  emit(c, tail ? OP_TAILCALL : OP_CALL); emit(c, v->count);
+}
+
+//Compile an if with literal branches. The branches are inlined, with a
+//generic call kept for when if has been rebound or the condition is bad.
+static void compile_if(lcode* c, lval* v, lval* slots, int tail) {
+  compile_expr(c, v->cell[0], slots);
+  compile_expr(c, v->cell[1], slots);
+  emit(c, OP_IF);
+  int on_false = emit(c, 0);
+  int generic = emit(c, 0);
+
+  compile_sexpr(c, v->cell[2], slots, tail);
+  emit(c, OP_JUMP);
+  int then_end = emit(c, 0);
+
+  c->code[on_false] = c->count;
+  compile_sexpr(c, v->cell[3], slots, tail);
+  emit(c, OP_JUMP);
+  int else_end = emit(c, 0);
+
+  c->code[generic] = c->count;
+  emit(c, OP_CONST); emit(c, add_const(c, v->cell[2]));
+  emit(c, OP_CONST); emit(c, add_const(c, v->cell[3]));
+  emit(c, OP_CALL); emit(c, 4);
+
+  c->code[then_end] = c->count;
+  c->code[else_end] = c->count;
+}
+
+//Find the slot a symbol resolves to in the running lambda, or -1. Only
+//the lambda's own frame is known here, variables from the calling
+//environments are dynamically scoped and looked up by name at runtime.
+static int resolve(lval* slots, lval* v) {
+  if (!slots) { return -1; }
+  for (int i = 0; i < slots->count; i++) {
+    if (slots->cell[i]->sym == v->sym) { return i; }
+  }
+  return -1;
+}
+
+static void compile_expr(lcode* c, lval* v, lval* slots) {
+  switch (v->type) {
+    case LVAL_SYM: {
+      int slot = resolve(slots, v);
+      if (slot >= 0) {
+        emit(c, OP_LOCAL); emit(c, slot);
+      } else {
+        emit(c, OP_LOAD); emit(c, add_const(c, v));
+      }
+    } break;
+    case LVAL_SEXPR:
+      compile_sexpr(c, v, slots, 0);
+    break;
+    // Everything else evaluates to itself
+    default:
+      emit(c, OP_CONST); emit(c, add_const(c, v));
+    break;
+  }
+}
+
+//Compile an expression to be evaluated
+lcode* vm_compile(lval* v) {
+  lcode* c = lcode_new();
+  compile_expr(c, v, NULL);
+  emit(c, OP_RET);
+  return c;
+}
+
+//Compile a lambda body, a q-expression evaluated as an s-expression.
+//Formals named in slots are read directly from the frame.
+lcode* vm_compile_body(lval* body, lval* slots) {
+  lcode* c = lcode_new();
+  compile_sexpr(c, body, slots, 1);
+  emit(c, OP_RET);
+  return c;
+}
+
+//Get the code for lambda f, compiled on first use. The code is a cache
+//so filling it in does not count as modifying a shared f.
+lcode* vm_code(lval* f) {
+  if (!f->code) { f->code = vm_compile_body(f->body, f->env->slots); }
+  return f->code;
+}
+
+void vm_code_del(lcode* c) {
+  if (--c->refs > 0) { return; }
+
+  for (int i = 0; i < c->nconsts; i++) {
+    lval_del(c->consts[i]);
+  }
+  free(c->consts);
+  free(c->code);
+  free(c);
+}
+
+//Stack of frames for one vm_run. Each frame holds a reference to its code.
+struct vm_frames {
+  int count;
+  int size;
+  struct vm_frame* frames;
+};
+
+static void push_frame(struct vm_frames* fs, lcode* c, lenv* e, lval* f) {
+  if (fs->count == fs->size) {
+    fs->size *= 2;
+    fs->frames = realloc(fs->frames, sizeof(struct vm_frame) * fs->size);
+  }
+  c->refs++;
+  fs->frames[fs->count].code = c;
+  fs->frames[fs->count].ip = 0;
+  fs->frames[fs->count].env = e;
+  fs->frames[fs->count].fn = f;
+  fs->count++;
+}
+
+//Run c in environment e. f is the bound lambda owning e if there is one,
+//it is deleted when the code returns.
+lval* vm_run(lenv* e, lcode* c, lval* f) {
+  struct vm_frames fs;
+  fs.count = 0;
+  fs.size = 8;
+  fs.frames = malloc(sizeof(struct vm_frame) * fs.size);
+  push_frame(&fs, c, e, f);
+
+  int top = 0;
+  int stack_size = 16;
+  lval** stack = malloc(sizeof(lval*) * stack_size);
+
+  while (1) {
+    struct vm_frame* fr = &fs.frames[fs.count-1];
+    int* code = fr->code->code;
+
+    //No instruction grows the stack by more than one
+    if (top == stack_size) {
+      stack_size *= 2;
+      stack = realloc(stack, sizeof(lval*) * stack_size);
+    }
+
+    int op = code[fr->ip++];
+    switch (op) {
+      case OP_CONST:
+        stack[top++] = lval_copy(fr->code->consts[code[fr->ip++]]);
+      break;
+
+      case OP_LOAD:
+        stack[top++] = lenv_get(fr->env, fr->code->consts[code[fr->ip++]]);
+      break;
+
+      case OP_LOCAL:
+        stack[top++] = lval_copy(fr->env->vals[code[fr->ip++]]);
+      break;
+
+      case OP_JUMP:
+        fr->ip = code[fr->ip];
+      break;
+
+      case OP_IF: {
+        int on_false = code[fr->ip++];
+        int generic = code[fr->ip++];
+        lval* fn = stack[top-2];
+        lval* cond = stack[top-1];
+
+        //Leave the stack alone and take the generic call
+        if (fn->type != LVAL_FUN || fn->builtin != builtin_if || cond->type != LVAL_NUM) {
+          fr->ip = generic;
+          break;
+        }
+
+        if (!cond->num) { fr->ip = on_false; }
+        lval_del(fn); lval_del(cond);
+        top -= 2;
+      } break;
+
+      case OP_CALL:
+      case OP_TAILCALL: {
+        int n = code[fr->ip++];
+        top -= n;
+        lval** args = &stack[top];
+
+        //Empty expression
+        if (n == 0) { stack[top++] = lval_sexpr(); break; }
+
+        //Return the first error, discarding the rest
+        int err = -1;
+        for (int i = 0; i < n; i++) {
+          if (args[i]->type == LVAL_ERR) { err = i; break; }
+        }
+        if (err >= 0) {
+          lval* x = args[err];
+          for (int i = 0; i < n; i++) {
+            if (i != err) { lval_del(args[i]); }
+          }
+          stack[top++] = x;
+          break;
+        }
+
+        //Single expression
+        if (n == 1) { top++; break; }
+
+        lval* fn = args[0];
+        if (fn->type != LVAL_FUN) {
+          for (int i = 0; i < n; i++) { lval_del(args[i]); }
+          stack[top++] = lval_err("First element is not a function.");
+          break;
+        }
+
+        //Move arguments into an argument list
+        lval* a = lval_resize(lval_sexpr(), n-1);
+        memcpy(a->cell, &args[1], sizeof(lval*) * a->count);
+
+        //Run eval'd expressions in the current environment on the vm
+        if (fn->builtin == builtin_eval) {
+          lval* x = builtin_eval_expr(a);
+          lval_del(fn);
+          if (x->type == LVAL_ERR) { stack[top++] = x; break; }
+
+          lcode* ec = vm_compile_body(x, NULL);
+          lval_del(x);
+          if (op == OP_TAILCALL) {
+            vm_code_del(fr->code);
+            fr->code = ec;
+            fr->ip = 0;
+          } else {
+            push_frame(&fs, ec, fr->env, NULL);
+            vm_code_del(ec);
+          }
+          break;
+        }
+
+        if (fn->builtin) {
+          stack[top++] = fn->builtin(fr->env, a);
+          lval_del(fn);
+          break;
+        }
+
+        vm_code(fn);
+        lval* g = lval_bind(fr->env, fn, a);
+        lval_del(fn);
+
+        //Errors and partially applied functions are results
+        if (g->type == LVAL_ERR || g->formals->count > 0) {
+          stack[top++] = g;
+          break;
+        }
+
+        //Replace the running lambda if nothing in its frame stays visible
+        g->env->par = fr->env;
+        if (op == OP_TAILCALL && fr->fn && lenv_shadows(g->env, fr->env)) {
+          g->env->par = fr->env->par;
+          g->code->refs++;
+          vm_code_del(fr->code);
+          lval_del(fr->fn);
+          fr->code = g->code;
+          fr->ip = 0;
+          fr->env = g->env;
+          fr->fn = g;
+          break;
+        }
+
+        //Enter the lambda body in a new frame
+        push_frame(&fs, g->code, g->env, g);
+      } break;
+
+      case OP_RET: {
+        lval* x = stack[--top];
+        vm_code_del(fr->code);
+        if (fr->fn) { lval_del(fr->fn); }
+        fs.count--;
+
+        if (fs.count == 0) {
+          free(stack);
+          free(fs.frames);
+          return x;
+        }
+        stack[top++] = x;
+      } break;
+    }
+  }
+}
+
+//Run the body of bound lambda f, deleting f afterwards
+lval* vm_apply(lval* f) {
+  return vm_run(f->env, vm_code(f), f);
+}
+
+//Compile and evaluate v
+lval* vm_eval(lenv* e, lval* v) {
+  lcode* c = vm_compile(v);
+  lval_del(v);
+
+  lval* x = vm_run(e, c, NULL);
+  vm_code_del(c);
+  return x;
+}
@@ -0,0 +1,44 @@
+#include "lval.h"
+
+#ifndef VM_H
+#define VM_H
+
+// Bytecode instructions, operands follow the opcode in the code array
+typedef enum {
+  OP_CONST,   // k     Push constant k
+  OP_LOAD,    // k     Push the value bound to symbol constant k
+  OP_LOCAL,   // i     Push slot i of the running lambda's frame
+  OP_CALL,    // n     Evaluate top n values as an s-expression
+  OP_TAILCALL,// n     As OP_CALL, reusing the running frame for a lambda
+  OP_IF,      // a b   Builtin if on top two values, jump to a if false, b if not builtin
+  OP_JUMP,    // a     Continue at a
+  OP_RET      //       Return top value to the calling frame
+} opcode_t;
+
+// Compiled expression
+struct lcode {
+  int refs;
+
+  int count;
+  int* code;
+
+  int nconsts;
+  lval** consts;
+};
+
+// Set to run evaluation through the bytecode vm instead of the tree walker,
+// for the interpreter a thread has entered
+extern __thread int vm_enabled;
+
+//Compiler functions
+lcode* vm_compile(lval* v);
+lcode* vm_compile_body(lval* body, lval* slots);
+lcode* vm_code(lval* f);
+void vm_code_del(lcode* c);
+
+//Execution functions
+lval* vm_run(lenv* e, lcode* c, lval* f);
+lval* vm_apply(lval* f);
+lval* vm_eval(lenv* e, lval* v);
+
+#endif